@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include "scan.h"
+#include "bricked_volume.h"
+#include "flying_edges.h"
+#include "marching_cubes.h"
+
+// Reproducible benchmarks of the scans and marching cubes paths. All inputs are generated
+// from a fixed seed, each configuration is timed over a number of repetitions after a
+// warm up run, and the results are written as JSON for comparing across versions.
+
+using namespace std::chrono;
+
+const uint32_t bench_seed = 5489;
+
+struct Stats {
+	double median_us = 0;
+	double p10_us = 0;
+	double p90_us = 0;
+	double min_us = 0;
+	double max_us = 0;
+};
+
+// Nearest rank percentile of the sorted samples
+double percentile(const std::vector<double> &sorted, const double p) {
+	const size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+Stats summarize(std::vector<double> samples) {
+	std::sort(samples.begin(), samples.end());
+	Stats stats;
+	stats.median_us = percentile(samples, 50);
+	stats.p10_us = percentile(samples, 10);
+	stats.p90_us = percentile(samples, 90);
+	stats.min_us = samples.front();
+	stats.max_us = samples.back();
+	return stats;
+}
+
+// Time reps runs of f after a warm up run, in microseconds. setup is run before each
+// run and isn't timed.
+template<typename S, typename F>
+Stats time_runs(const size_t reps, S setup, F f) {
+	setup();
+	f();
+	std::vector<double> samples;
+	for (size_t i = 0; i < reps; ++i) {
+		setup();
+		const auto start = steady_clock::now();
+		f();
+		const auto end = steady_clock::now();
+		samples.push_back(duration<double, std::micro>(end - start).count());
+	}
+	return summarize(samples);
+}
+
+// Collects the results as a JSON array of flat objects
+class Results {
+	std::vector<std::string> records;
+
+public:
+	// fields is a list of "key": value pairs, already formatted as JSON
+	void add(const std::string &fields, const Stats &stats, const size_t bytes) {
+		std::ostringstream rec;
+		rec << "{" << fields
+			<< ", \"median_us\": " << stats.median_us
+			<< ", \"p10_us\": " << stats.p10_us
+			<< ", \"p90_us\": " << stats.p90_us
+			<< ", \"min_us\": " << stats.min_us
+			<< ", \"max_us\": " << stats.max_us
+			<< ", \"bytes\": " << bytes
+			<< ", \"gbps\": " << bytes / (stats.median_us * 1e3) << "}";
+		records.push_back(rec.str());
+		std::cerr << records.back() << "\n";
+	}
+
+	void write(std::ostream &os, const size_t reps) const {
+		os << "{\n\"seed\": " << bench_seed
+			<< ",\n\"reps\": " << reps
+			<< ",\n\"hardware_threads\": " << std::thread::hardware_concurrency()
+			<< ",\n\"results\": [\n";
+		for (size_t i = 0; i < records.size(); ++i) {
+			os << "\t" << records[i] << (i + 1 < records.size() ? ",\n" : "\n");
+		}
+		os << "]\n}\n";
+	}
+};
+
+// Synthetic uint8 volumes of n^3 voxels, each spanning the full value range
+enum class SyntheticVolume {
+	// Distance from the center, a single closed surface
+	SPHERE,
+	// Trilinearly interpolated random lattice values, many small surfaces
+	NOISE,
+	// Gyroid triply periodic surface, a large connected surface through the whole volume
+	GYROID
+};
+
+const char* volume_name(const SyntheticVolume v) {
+	switch (v) {
+	case SyntheticVolume::SPHERE: return "sphere";
+	case SyntheticVolume::NOISE: return "noise";
+	case SyntheticVolume::GYROID: return "gyroid";
+	}
+	return "";
+}
+
+std::vector<uint8_t> make_volume(const SyntheticVolume type, const size_t n) {
+	// Random lattice for the noise volume, with a lattice point every 8 voxels
+	const size_t lattice_spacing = 8;
+	const size_t lattice_n = n / lattice_spacing + 2;
+	std::vector<float> lattice(lattice_n * lattice_n * lattice_n);
+	std::mt19937 rng(bench_seed);
+	std::uniform_real_distribution<float> distrib(0.f, 255.f);
+	for (auto &l : lattice) {
+		l = distrib(rng);
+	}
+
+	std::vector<uint8_t> volume(n * n * n);
+	tbb::parallel_for(size_t(0), n,
+		[&](const size_t k) {
+			for (size_t j = 0; j < n; ++j) {
+				for (size_t i = 0; i < n; ++i) {
+					float value = 0;
+					if (type == SyntheticVolume::SPHERE) {
+						const float c = (n - 1) / 2.f;
+						const float d = std::sqrt((i - c) * (i - c) + (j - c) * (j - c) + (k - c) * (k - c));
+						value = 255.f * std::min(d / c, 1.f);
+					} else if (type == SyntheticVolume::NOISE) {
+						const size_t p[3] = {i / lattice_spacing, j / lattice_spacing, k / lattice_spacing};
+						const float t[3] = {float(i % lattice_spacing) / lattice_spacing,
+							float(j % lattice_spacing) / lattice_spacing,
+							float(k % lattice_spacing) / lattice_spacing};
+						for (size_t v = 0; v < 8; ++v) {
+							const vec3i &o = index_to_vertex[v];
+							const float w = (o[0] ? t[0] : 1 - t[0]) * (o[1] ? t[1] : 1 - t[1])
+								* (o[2] ? t[2] : 1 - t[2]);
+							value += w * lattice[((p[2] + o[2]) * lattice_n + p[1] + o[1]) * lattice_n + p[0] + o[0]];
+						}
+					} else {
+						// 4 periods of the gyroid across the volume
+						const float s = 4 * 2 * 3.14159265f / n;
+						const float g = std::sin(i * s) * std::cos(j * s) + std::sin(j * s) * std::cos(k * s)
+							+ std::sin(k * s) * std::cos(i * s);
+						value = (g + 1.5f) / 3.f * 255.f;
+					}
+					volume[(k * n + j) * n + i] = uint8_t(std::min(std::max(value, 0.f), 255.f));
+				}
+			}
+		});
+	return volume;
+}
+
+template<typename T>
+const char* type_name();
+template<> const char* type_name<int32_t>() { return "int32"; }
+template<> const char* type_name<float>() { return "float32"; }
+template<> const char* type_name<int64_t>() { return "int64"; }
+
+const char* backend_name(const ScanBackend backend) {
+	return backend == ScanBackend::TBB ? "tbb" : "lookback";
+}
+
+template<typename T>
+void bench_scans(Results &results, const size_t n, const size_t threads, const size_t reps) {
+	std::vector<T> in(n);
+	std::mt19937 rng(bench_seed);
+	std::uniform_int_distribution<int> distrib(0, 16);
+	for (auto &x : in) {
+		x = T(distrib(rng));
+	}
+	std::vector<T> out(n);
+	// Each element is read once and written once
+	const size_t bytes = 2 * n * sizeof(T);
+	for (const auto backend : {ScanBackend::TBB, ScanBackend::DECOUPLED_LOOKBACK}) {
+		for (const bool inclusive : {true, false}) {
+			const Stats stats = time_runs(reps, [] {},
+				[&] {
+					if (inclusive) {
+						::inclusive_scan(in.data(), in.data() + n, out.data(), T(0), std::plus<T>{}, backend);
+					} else {
+						::exclusive_scan(in.data(), in.data() + n, out.data(), T(0), std::plus<T>{}, backend);
+					}
+				});
+			std::ostringstream fields;
+			fields << "\"benchmark\": \"" << (inclusive ? "inclusive_scan" : "exclusive_scan") << "\""
+				<< ", \"type\": \"" << type_name<T>() << "\""
+				<< ", \"backend\": \"" << backend_name(backend) << "\""
+				<< ", \"size\": " << n
+				<< ", \"threads\": " << threads;
+			results.add(fields.str(), stats, bytes);
+		}
+	}
+}
+
+void bench_marching_cubes(Results &results, const SyntheticVolume type, const size_t n,
+		const size_t threads, const size_t reps)
+{
+	const VolumeSource<uint8_t> volume(make_volume(type, n));
+	const vec3sz dims = {n, n, n};
+	const float isovalue = 127.5f;
+	std::vector<vec3f> vertices;
+	std::vector<uint32_t> indices;
+	auto clear = [&] {
+		vertices.clear();
+		indices.clear();
+	};
+	auto record = [&](const char *path, const Stats &stats) {
+		std::ostringstream fields;
+		fields << "\"benchmark\": \"marching_cubes\""
+			<< ", \"volume\": \"" << volume_name(type) << "\""
+			<< ", \"path\": \"" << path << "\""
+			<< ", \"size\": " << n
+			<< ", \"threads\": " << threads
+			<< ", \"isovalue\": " << isovalue
+			<< ", \"triangles\": " << (indices.empty() ? vertices.size() : indices.size()) / 3;
+		results.add(fields.str(), stats, volume.size());
+	};
+
+	// The serial path doesn't depend on the thread count
+	if (threads == 1) {
+		record("serial", time_runs(reps, clear,
+			[&] {
+				marching_cubes(volume, dims, isovalue, vertices);
+			}));
+	}
+	record("parallel", time_runs(reps, clear,
+		[&] {
+			data_parallel_marching_cubes(volume, dims, isovalue, vertices);
+		}));
+	record("indexed", time_runs(reps, clear,
+		[&] {
+			indexed_marching_cubes(volume, dims, isovalue, vertices, indices);
+		}));
+	record("flying_edges", time_runs(reps, clear,
+		[&] {
+			flying_edges_marching_cubes(volume, dims, isovalue, vertices, indices);
+		}));
+}
+
+// A batch of nested isosurfaces, extracted in one batch and one isovalue at a time
+void bench_batch_marching_cubes(Results &results, const SyntheticVolume type, const size_t n,
+		const size_t threads, const size_t reps)
+{
+	const VolumeSource<uint8_t> volume(make_volume(type, n));
+	const vec3sz dims = {n, n, n};
+	std::vector<float> isovalues;
+	for (size_t i = 0; i < 8; ++i) {
+		isovalues.push_back(16.5f + 28 * i);
+	}
+	std::vector<std::vector<vec3f>> meshes(isovalues.size());
+	auto clear = [&] {
+		for (auto &m : meshes) {
+			m.clear();
+		}
+	};
+	auto record = [&](const char *path, const Stats &stats) {
+		size_t num_verts = 0;
+		for (const auto &m : meshes) {
+			num_verts += m.size();
+		}
+		std::ostringstream fields;
+		fields << "\"benchmark\": \"batch_marching_cubes\""
+			<< ", \"volume\": \"" << volume_name(type) << "\""
+			<< ", \"path\": \"" << path << "\""
+			<< ", \"size\": " << n
+			<< ", \"threads\": " << threads
+			<< ", \"isovalues\": " << isovalues.size()
+			<< ", \"triangles\": " << num_verts / 3;
+		results.add(fields.str(), stats, volume.size());
+	};
+
+	record("batch", time_runs(reps, clear,
+		[&] {
+			batch_marching_cubes(volume, dims, isovalues, meshes);
+		}));
+	record("sequential", time_runs(reps, clear,
+		[&] {
+			for (size_t i = 0; i < isovalues.size(); ++i) {
+				data_parallel_marching_cubes(volume, dims, isovalues[i], meshes[i]);
+			}
+		}));
+}
+
+// The bricked layout against the row major volume, both without and with skipping the
+// bricks which can't contain the surface. The conversion to bricks is timed separately.
+void bench_bricked_layout(Results &results, const SyntheticVolume type, const size_t n,
+		const size_t threads, const size_t reps)
+{
+	const size_t brick_size = 16;
+	const VolumeSource<uint8_t> volume(make_volume(type, n));
+	const vec3sz dims = {n, n, n};
+	const float isovalue = 127.5f;
+	std::vector<vec3f> vertices;
+	auto clear = [&] {
+		vertices.clear();
+	};
+	auto record = [&](const char *path, const Stats &stats) {
+		std::ostringstream fields;
+		fields << "\"benchmark\": \"volume_layout\""
+			<< ", \"volume\": \"" << volume_name(type) << "\""
+			<< ", \"path\": \"" << path << "\""
+			<< ", \"size\": " << n
+			<< ", \"threads\": " << threads
+			<< ", \"brick_size\": " << brick_size
+			<< ", \"isovalue\": " << isovalue
+			<< ", \"triangles\": " << vertices.size() / 3;
+		results.add(fields.str(), stats, volume.size());
+	};
+
+	record("row_major", time_runs(reps, clear,
+		[&] {
+			data_parallel_marching_cubes(volume, dims, isovalue, vertices);
+		}));
+	const MacrocellGrid<uint8_t> grid(volume, dims, brick_size);
+	record("row_major_macrocell", time_runs(reps, clear,
+		[&] {
+			data_parallel_marching_cubes(volume, dims, isovalue, vertices, ScanBackend::TBB, &grid);
+		}));
+	BrickedVolume<uint8_t> bricked;
+	record("bricked_convert", time_runs(reps, [&] {},
+		[&] {
+			bricked = BrickedVolume<uint8_t>(volume, dims, brick_size);
+		}));
+	record("bricked", time_runs(reps, clear,
+		[&] {
+			bricked_marching_cubes(bricked, isovalue, vertices);
+		}));
+}
+
+// Parse the list of numbers following args[i], leaving i on the last one
+std::vector<size_t> parse_list(const std::vector<std::string> &args, size_t &i) {
+	std::vector<size_t> list;
+	while (i + 1 < args.size() && args[i + 1][0] != '-') {
+		list.push_back(std::stoull(args[++i]));
+	}
+	return list;
+}
+
+int main(int argc, char **argv) {
+	const std::vector<std::string> args(argv, argv + argc);
+	std::string output;
+	size_t reps = 10;
+	std::vector<size_t> scan_sizes = {1 << 16, 1 << 20, 1 << 24};
+	std::vector<size_t> mc_sizes = {64, 128, 256};
+	std::vector<size_t> layout_sizes = {512, 1024};
+	std::vector<size_t> thread_counts = {1};
+	if (std::thread::hardware_concurrency() > 1) {
+		thread_counts.push_back(std::thread::hardware_concurrency());
+	}
+	for (size_t i = 1; i < args.size(); ++i) {
+		if (args[i] == "-o") {
+			output = args[++i];
+		} else if (args[i] == "-reps") {
+			reps = std::stoull(args[++i]);
+		} else if (args[i] == "-scan-sizes") {
+			scan_sizes = parse_list(args, i);
+		} else if (args[i] == "-mc-sizes") {
+			mc_sizes = parse_list(args, i);
+		} else if (args[i] == "-layout-sizes") {
+			layout_sizes = parse_list(args, i);
+		} else if (args[i] == "-threads") {
+			thread_counts = parse_list(args, i);
+		} else {
+			std::cout << "Usage: " << args[0] << " [options]\n"
+				<< "\t-o <file> writes the JSON results to the file instead of stdout\n"
+				<< "\t-reps <n> timed repetitions of each benchmark (default 10)\n"
+				<< "\t-scan-sizes <n...> element counts for the scan benchmarks\n"
+				<< "\t-mc-sizes <n...> volume sizes (n^3) for the marching cubes benchmarks\n"
+				<< "\t-layout-sizes <n...> volume sizes (n^3) for the bricked against row major benchmarks\n"
+				<< "\t-threads <n...> thread counts to run with\n";
+			return 1;
+		}
+	}
+	if (reps == 0) {
+		std::cerr << "-reps must be at least 1\n";
+		return 1;
+	}
+
+	Results results;
+	for (const size_t threads : thread_counts) {
+		tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads);
+		for (const size_t n : scan_sizes) {
+			bench_scans<int32_t>(results, n, threads, reps);
+			bench_scans<float>(results, n, threads, reps);
+			bench_scans<int64_t>(results, n, threads, reps);
+		}
+		for (const size_t n : mc_sizes) {
+			for (const auto type : {SyntheticVolume::SPHERE, SyntheticVolume::NOISE, SyntheticVolume::GYROID}) {
+				bench_marching_cubes(results, type, n, threads, reps);
+			}
+			bench_batch_marching_cubes(results, SyntheticVolume::SPHERE, n, threads, reps);
+		}
+		// Only the sphere is run, the meshes of the other volumes fill the volume and take
+		// several GB at these sizes
+		for (const size_t n : layout_sizes) {
+			bench_bricked_layout(results, SyntheticVolume::SPHERE, n, threads, reps);
+		}
+	}
+
+	if (output.empty()) {
+		results.write(std::cout, reps);
+	} else {
+		std::ofstream fout(output.c_str());
+		results.write(fout, reps);
+	}
+	return 0;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include "marching_cubes.h"
+
+// A copy of a row major volume rearranged into bricks of brick_size^3 cells for cache
+// friendly extraction. Each brick stores the (brick_size + 1)^3 voxels at the corners of its
+// cells contiguously, duplicating the faces it shares with the next bricks, so every cell's
+// 8 corners lie within a few KB of each other instead of on 4 rows across 2 slices of the
+// volume, and a task working on a brick touches a couple of pages instead of one per row.
+// Bricks at the far edges of the volume are padded by repeating the last voxel on each axis.
+// The value range of each brick is kept so bricks which can't contain the isosurface are
+// skipped, as with the MacrocellGrid. The brick size must be a power of two so positions
+// within a brick are found with shifts and masks.
+template<typename T>
+struct BrickedVolume {
+	// Dimensions of the volume in voxels
+	vec3sz dims = {0};
+	size_t brick_shift = 4;
+	// Number of cells along each side of a brick
+	size_t brick_size = 16;
+	// Number of bricks along each axis
+	vec3sz brick_dims = {0};
+	// The voxels of each brick, brick b's start at voxels[b * brick_voxels()]
+	std::vector<T> voxels;
+	// The [min, max] voxel values of each brick
+	std::vector<std::array<T, 2>> ranges;
+
+	BrickedVolume() = default;
+
+	BrickedVolume(const VolumeSource<T> &volume, const vec3sz &volume_dims, const size_t brick_size = 16)
+		: dims(volume_dims), brick_size(brick_size)
+	{
+		if (brick_size < 2 || (brick_size & (brick_size - 1)) != 0) {
+			throw std::runtime_error("BrickedVolume: brick size must be a power of two >= 2");
+		}
+		brick_shift = 0;
+		while ((size_t(1) << brick_shift) < brick_size) {
+			++brick_shift;
+		}
+		for (size_t i = 0; i < 3; ++i) {
+			brick_dims[i] = (dims[i] - 1 + brick_size - 1) / brick_size;
+		}
+		const size_t side = brick_size + 1;
+		voxels.resize(num_bricks() * brick_voxels());
+		ranges.resize(num_bricks());
+		tbb::parallel_for(size_t(0), num_bricks(),
+			[&](const size_t b) {
+				const vec3sz origin = brick_origin(b);
+				T *out = brick(b);
+				std::array<T, 2> range = {std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest()};
+				for (size_t k = 0; k < side; ++k) {
+					const size_t z = std::min(origin[2] + k, dims[2] - 1);
+					for (size_t j = 0; j < side; ++j) {
+						const size_t y = std::min(origin[1] + j, dims[1] - 1);
+						const T *row = volume.data() + (z * dims[1] + y) * dims[0] + origin[0];
+						const size_t count = std::min(side, dims[0] - origin[0]);
+						std::copy(row, row + count, out);
+						std::fill(out + count, out + side, row[count - 1]);
+						for (size_t i = 0; i < count; ++i) {
+							range[0] = std::min(range[0], row[i]);
+							range[1] = std::max(range[1], row[i]);
+						}
+						out += side;
+					}
+				}
+				ranges[b] = range;
+			});
+	}
+
+	size_t num_bricks() const {
+		return brick_dims[0] * brick_dims[1] * brick_dims[2];
+	}
+
+	// Number of voxels stored for each brick
+	size_t brick_voxels() const {
+		return (brick_size + 1) * (brick_size + 1) * (brick_size + 1);
+	}
+
+	const T* brick(const size_t b) const {
+		return voxels.data() + b * brick_voxels();
+	}
+
+	T* brick(const size_t b) {
+		return voxels.data() + b * brick_voxels();
+	}
+
+	// The position of the first cell of the brick in the volume
+	vec3sz brick_origin(const size_t b) const {
+		return vec3sz{(b % brick_dims[0]) << brick_shift,
+			((b / brick_dims[0]) % brick_dims[1]) << brick_shift,
+			(b / (brick_dims[0] * brick_dims[1])) << brick_shift};
+	}
+
+	// The number of cells of the brick along each axis, which is less than the brick size
+	// for bricks at the far edges of the volume
+	vec3sz brick_cells(const size_t b) const {
+		const vec3sz origin = brick_origin(b);
+		vec3sz cells;
+		for (size_t i = 0; i < 3; ++i) {
+			cells[i] = std::min(brick_size, dims[i] - 1 - origin[i]);
+		}
+		return cells;
+	}
+
+	// A cell is active if some corner is <= the isovalue and another is above it,
+	// so the brick can only contain active cells if its range straddles the isovalue
+	bool brick_may_be_active(const size_t b, const float isovalue) const {
+		return ranges[b][0] <= isovalue && ranges[b][1] > isovalue;
+	}
+
+	size_t bytes() const {
+		return voxels.size() * sizeof(T) + ranges.size() * sizeof(std::array<T, 2>);
+	}
+};
+
+// Data parallel marching cubes over a bricked volume, run with a task per brick. Each brick
+// is classified row by row with the row kernels of classify_simd.h, reading only the brick's
+// voxels, and its active voxels are compacted with their IDs local to the brick. Vertices
+// are then generated brick by brick, finding each cell's position from the brick's origin and
+// its local ID with shifts and masks. The triangles are the same as data_parallel_marching_cubes
+// outputs, ordered by brick instead of by cell ID.
+template<typename T>
+void bricked_marching_cubes(const BrickedVolume<T> &volume, const float isovalue,
+		std::vector<vec3f> &vertices, const ScanBackend scan_backend = ScanBackend::TBB,
+		ExtractionStats *stats = nullptr)
+{
+	const size_t num_bricks = volume.num_bricks();
+	const size_t side = volume.brick_size + 1;
+	const size_t shift = volume.brick_shift;
+	const size_t mask = volume.brick_size - 1;
+
+	StageTimer classify_timer(stats, "classify");
+	const iso_threshold_t<T> threshold = iso_threshold<T>(isovalue);
+	std::vector<ActiveVoxel<T>> active_voxels;
+	CompactWorkspace<ActiveVoxel<T>> workspace;
+	// Where each brick's active voxels start
+	std::vector<size_t> brick_starts;
+	tbb::enumerable_thread_specific<std::vector<uint8_t>> case_buffers;
+	compact_tiles(num_bricks, active_voxels, brick_starts,
+		[&](const size_t b, std::vector<ActiveVoxel<T>> &brick_active) {
+			STATS_RECORD(stats, count_task());
+			if (!volume.brick_may_be_active(b, isovalue)) {
+				return;
+			}
+			const vec3sz cells = volume.brick_cells(b);
+			const T *brick = volume.brick(b);
+			std::vector<uint8_t> &cases = case_buffers.local();
+			cases.resize(volume.brick_size);
+			for (size_t k = 0; k < cells[2]; ++k) {
+				for (size_t j = 0; j < cells[1]; ++j) {
+					const T *rows[4];
+					for (size_t r = 0; r < 4; ++r) {
+						rows[r] = brick + ((k + r / 2) * side + j + r % 2) * side;
+					}
+					simd::row_cube_cases(rows, 0, cells[0], threshold, cases.data());
+					append_active_cells(rows, ((k << shift) + j) << shift, 0, cells[0], cases.data(),
+							brick_active);
+				}
+			}
+		},
+		workspace);
+	classify_timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+	STATS_RECORD(stats, active_voxels += active_voxels.size());
+
+	StageTimer count_timer(stats, "count_vertices");
+	std::vector<uint32_t> num_verts(active_voxels.size());
+	counted_parallel_for(num_verts.size(), stats,
+		[&](const size_t v) {
+			num_verts[v] = case_num_verts[active_voxels[v].cube_case];
+		});
+	count_timer.stop(num_verts.size() * sizeof(uint32_t));
+
+	StageTimer scan_timer(stats, "scan_vertices");
+	TwoLevelOffsets offsets;
+	const uint64_t total_verts = two_level_exclusive_scan(num_verts.data(), num_verts.size(),
+			max_case_verts, offsets, scan_backend);
+	scan_timer.stop();
+
+	StageTimer generate_timer(stats, "generate_vertices");
+	vertices.resize(total_verts);
+	tbb::parallel_for(size_t(0), num_bricks,
+		[&](const size_t b) {
+			STATS_RECORD(stats, count_task());
+			const size_t begin = brick_starts[b];
+			const size_t end = b + 1 < num_bricks ? brick_starts[b + 1] : active_voxels.size();
+			if (begin == end) {
+				return;
+			}
+			const vec3sz origin = volume.brick_origin(b);
+			for (size_t v = begin; v < end; ++v) {
+				const size_t id = active_voxels[v].id;
+				const vec3sz voxel = {origin[0] + (id & mask), origin[1] + ((id >> shift) & mask),
+					origin[2] + (id >> (2 * shift))};
+				generate_cell_vertices(voxel, isovalue, active_voxels[v], offsets(num_verts.data(), v),
+						vertices);
+			}
+		});
+	generate_timer.stop(vertices.size() * sizeof(vec3f));
+	STATS_RECORD(stats, vertices += vertices.size());
+	STATS_RECORD(stats, freed(num_verts.size() * sizeof(uint32_t)));
+	STATS_RECORD(stats, freed(active_voxels.size() * sizeof(ActiveVoxel<T>)));
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "scan_simd.h"
+
+// Cube case kernels classifying an x-row of cells at once. The cells of the row (j, k)
+// have their corners on the 4 voxel rows (j, k), (j + 1, k), (j, k + 1) and (j + 1, k + 1),
+// passed as rows[0..3]. For each cell i in [begin, end), cases[i - begin] is set to the
+// cube case, which has bit v set if corner v (numbered as in index_to_vertex) is <= the
+// threshold. Corner v of cell i is the voxel rows[row_corner_row[v]][i + row_corner_dx[v]].
+namespace simd {
+
+constexpr std::array<uint8_t, 8> row_corner_row = {0, 0, 1, 1, 2, 2, 3, 3};
+constexpr std::array<uint8_t, 8> row_corner_dx = {0, 1, 1, 0, 0, 1, 1, 0};
+
+// Cube case bit of the corner on each row at dx = 0 and dx = 1
+constexpr std::array<uint8_t, 4> row_case_bit_lo = {1 << 0, 1 << 3, 1 << 4, 1 << 7};
+constexpr std::array<uint8_t, 4> row_case_bit_hi = {1 << 1, 1 << 2, 1 << 5, 1 << 6};
+
+// The scalar kernel compares each column of 4 voxels once, giving a 4 bit mask of which
+// rows are <= the threshold, and builds each case from the masks of its two columns
+template<typename T, typename S>
+void scalar_row_cases(const T *const rows[4], const size_t begin, const size_t end,
+		const S threshold, uint8_t *cases)
+{
+	auto column_mask = [&](const size_t x) {
+		return (rows[0][x] <= threshold ? 1 : 0) | (rows[1][x] <= threshold ? 2 : 0)
+			| (rows[2][x] <= threshold ? 4 : 0) | (rows[3][x] <= threshold ? 8 : 0);
+	};
+	auto column_case = [](const int mask, const std::array<uint8_t, 4> &bits) {
+		uint8_t c = 0;
+		for (size_t r = 0; r < 4; ++r) {
+			if (mask & (1 << r)) {
+				c |= bits[r];
+			}
+		}
+		return c;
+	};
+	if (begin == end) {
+		return;
+	}
+	int lo = column_mask(begin);
+	for (size_t x = begin; x < end; ++x) {
+		const int hi = column_mask(x + 1);
+		cases[x - begin] = column_case(lo, row_case_bit_lo) | column_case(hi, row_case_bit_hi);
+		lo = hi;
+	}
+}
+
+#if defined(SCAN_SIMD_X86)
+
+// Load the voxels of the 4 rows at x and x + 1, the corners of the 16 cells starting at x
+inline void sse2_load_corners_u8(const uint8_t *const rows[4], const size_t x, __m128i lo[4], __m128i hi[4]) {
+	for (size_t r = 0; r < 4; ++r) {
+		lo[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + x));
+		hi[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + x + 1));
+	}
+}
+
+// Compare the loaded corners against the threshold with an unsigned min, and reduce the
+// compare masks to the cube case bytes of the cells
+inline __m128i sse2_corner_cases_u8(const __m128i lo[4], const __m128i hi[4], const __m128i t) {
+	__m128i c = _mm_setzero_si128();
+	for (size_t r = 0; r < 4; ++r) {
+		const __m128i lo_le = _mm_cmpeq_epi8(_mm_min_epu8(lo[r], t), lo[r]);
+		const __m128i hi_le = _mm_cmpeq_epi8(_mm_min_epu8(hi[r], t), hi[r]);
+		c = _mm_or_si128(c, _mm_and_si128(lo_le, _mm_set1_epi8(char(row_case_bit_lo[r]))));
+		c = _mm_or_si128(c, _mm_and_si128(hi_le, _mm_set1_epi8(char(row_case_bit_hi[r]))));
+	}
+	return c;
+}
+
+// Classifies 16 cells per iteration against each of the n thresholds, writing the cases
+// for thresholds[s] to cases[s]. The corners are loaded once for all the thresholds. Rows
+// which aren't a multiple of 16 cells long finish with a block overlapping the previous
+// one, rather than classifying the remaining cells one at a time.
+inline void sse2_row_cases_u8(const uint8_t *const rows[4], const size_t begin, const size_t end,
+		const uint8_t *thresholds, const size_t n, uint8_t *const *cases)
+{
+	if (end - begin < 16) {
+		for (size_t s = 0; s < n; ++s) {
+			scalar_row_cases(rows, begin, end, thresholds[s], cases[s]);
+		}
+		return;
+	}
+	__m128i lo[4], hi[4];
+	for (size_t x = begin; x < end; x += 16) {
+		x = std::min(x, end - 16);
+		sse2_load_corners_u8(rows, x, lo, hi);
+		for (size_t s = 0; s < n; ++s) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(cases[s] + x - begin),
+				sse2_corner_cases_u8(lo, hi, _mm_set1_epi8(char(thresholds[s]))));
+		}
+	}
+}
+
+#endif
+
+#if defined(SCAN_SIMD_AVX2)
+
+// AVX2 versions of the SSE2 kernels above, classifying 32 cells per iteration
+SCAN_TARGET_AVX2 inline void avx2_load_corners_u8(const uint8_t *const rows[4], const size_t x,
+		__m256i lo[4], __m256i hi[4])
+{
+	for (size_t r = 0; r < 4; ++r) {
+		lo[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x));
+		hi[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x + 1));
+	}
+}
+
+SCAN_TARGET_AVX2 inline __m256i avx2_corner_cases_u8(const __m256i lo[4], const __m256i hi[4],
+		const __m256i t)
+{
+	__m256i c = _mm256_setzero_si256();
+	for (size_t r = 0; r < 4; ++r) {
+		const __m256i lo_le = _mm256_cmpeq_epi8(_mm256_min_epu8(lo[r], t), lo[r]);
+		const __m256i hi_le = _mm256_cmpeq_epi8(_mm256_min_epu8(hi[r], t), hi[r]);
+		c = _mm256_or_si256(c, _mm256_and_si256(lo_le, _mm256_set1_epi8(char(row_case_bit_lo[r]))));
+		c = _mm256_or_si256(c, _mm256_and_si256(hi_le, _mm256_set1_epi8(char(row_case_bit_hi[r]))));
+	}
+	return c;
+}
+
+SCAN_TARGET_AVX2 inline void avx2_row_cases_u8(const uint8_t *const rows[4], const size_t begin,
+		const size_t end, const uint8_t *thresholds, const size_t n, uint8_t *const *cases)
+{
+	if (end - begin < 32) {
+		sse2_row_cases_u8(rows, begin, end, thresholds, n, cases);
+		return;
+	}
+	__m256i lo[4], hi[4];
+	for (size_t x = begin; x < end; x += 32) {
+		x = std::min(x, end - 32);
+		avx2_load_corners_u8(rows, x, lo, hi);
+		for (size_t s = 0; s < n; ++s) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(cases[s] + x - begin),
+				avx2_corner_cases_u8(lo, hi, _mm256_set1_epi8(char(thresholds[s]))));
+		}
+	}
+}
+
+#endif
+
+// Compute the cube cases of the cells [begin, end) of the row against each of the n
+// thresholds, writing the cases for thresholds[s] to cases[s], which must have room for
+// end - begin cases. Reading cell end - 1 reads voxel end on each row, so end must be at
+// most the row length - 1. uint8 volumes use the SIMD kernels, which classify a block of
+// cells against all the thresholds while its corners are in registers, and other voxel
+// types the scalar kernel.
+template<typename T, typename S>
+void row_cube_cases(const T *const rows[4], const size_t begin, const size_t end,
+		const S *thresholds, const size_t n, uint8_t *const *cases)
+{
+	if constexpr (std::is_same<T, uint8_t>::value && std::is_integral<S>::value) {
+		if (detect_isa() != Isa::SCALAR) {
+			// The kernels take the thresholds in batches of up to 16 which are in [0, 255),
+			// thresholds outside it put all voxels on the same side
+			uint8_t batch_thresholds[16];
+			uint8_t *batch_cases[16];
+			size_t m = 0;
+			for (size_t s = 0; s < n; ++s) {
+				if (thresholds[s] < 0 || thresholds[s] >= 255) {
+					std::fill(cases[s], cases[s] + (end - begin), thresholds[s] < 0 ? 0 : 255);
+				} else {
+					batch_thresholds[m] = uint8_t(thresholds[s]);
+					batch_cases[m++] = cases[s];
+				}
+				if (m == 16 || (s + 1 == n && m > 0)) {
+					switch (detect_isa()) {
+#if defined(SCAN_SIMD_AVX2)
+					case Isa::AVX2: avx2_row_cases_u8(rows, begin, end, batch_thresholds, m, batch_cases); break;
+#endif
+#if defined(SCAN_SIMD_X86)
+					case Isa::SSE2: sse2_row_cases_u8(rows, begin, end, batch_thresholds, m, batch_cases); break;
+#endif
+					default: break;
+					}
+					m = 0;
+				}
+			}
+			return;
+		}
+	}
+	for (size_t s = 0; s < n; ++s) {
+		scalar_row_cases(rows, begin, end, thresholds[s], cases[s]);
+	}
+}
+
+// Compute the cube cases of the cells [begin, end) of the row against the threshold, see above
+template<typename T, typename S>
+void row_cube_cases(const T *const rows[4], const size_t begin, const size_t end,
+		const S threshold, uint8_t *cases)
+{
+	row_cube_cases(rows, begin, end, &threshold, 1, &cases);
+}
+
+}
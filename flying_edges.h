@@ -0,0 +1,373 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include "marching_cubes.h"
+
+// Flying Edges isosurface extraction (Schroeder, Maynard and Geveci, 2015). Rather than
+// visiting each cell and interpolating each of its crossed edges, the volume is processed
+// in independent x-rows. Each row's edges are classified once, the rows are trimmed to the
+// range of x which can contain the surface, and every edge crossing is interpolated
+// exactly once. The passes are:
+//   1. Classify the voxels of each row against the isovalue, counting the x-edge
+//      crossings and finding the row's trim range.
+//   2. Count the y and z-edge crossings of each row and the triangles of each row of
+//      cells, within the trim ranges of the rows involved.
+//   3. Scan the per-row counts to find each row's vertex and triangle offsets.
+//   4. Interpolate the vertices of each row and generate the triangles of each row of cells,
+//      finding the vertex of each triangle edge from running counts of the crossings along
+//      the cell row instead of searching for it.
+// The voxels are classified again from their values in each pass rather than storing the
+// classification, which would take another volume sized array. The output is an indexed mesh
+// of the same surface and triangles, in the same order, as extract_indexed_mesh produces,
+// with the vertices numbered by row instead of by cell.
+
+namespace detail {
+
+// How the vertex of each cube edge is found while walking a row of cells. X-edges lie on one
+// of the 4 voxel rows at the cell's corners, numbered dy + 2 * dz as in classify_simd.h.
+// Y-edges lie on the rows at dz = 0 or 1 and z-edges on those at dy = 0 or 1, and both may
+// be at the cell's x or x + 1.
+struct FlyingEdgesEdge {
+	uint8_t axis;
+	uint8_t row;
+	uint8_t dx;
+};
+
+constexpr std::array<FlyingEdgesEdge, 12> make_flying_edges_edges() {
+	std::array<FlyingEdgesEdge, 12> edges = {};
+	for (size_t e = 0; e < edges.size(); ++e) {
+		const vec3i &o = index_to_vertex[edge_origin[e]];
+		edges[e].axis = edge_axis[e];
+		edges[e].dx = uint8_t(o[0]);
+		if (edge_axis[e] == 0) {
+			edges[e].row = uint8_t(o[1] + 2 * o[2]);
+		} else if (edge_axis[e] == 1) {
+			edges[e].row = uint8_t(o[2]);
+		} else {
+			edges[e].row = uint8_t(o[1]);
+		}
+	}
+	return edges;
+}
+
+constexpr std::array<FlyingEdgesEdge, 12> flying_edges_edges = make_flying_edges_edges();
+
+// The cube case bits of a column of 4 corners, given the mask of which of its rows are
+// inside the surface, for the column at the cell's x and x + 1
+constexpr std::array<uint8_t, 16> make_column_cases(const std::array<uint8_t, 4> &bits) {
+	std::array<uint8_t, 16> cases = {0};
+	for (size_t m = 0; m < cases.size(); ++m) {
+		for (size_t r = 0; r < 4; ++r) {
+			if (m & (1 << r)) {
+				cases[m] |= bits[r];
+			}
+		}
+	}
+	return cases;
+}
+
+constexpr std::array<uint8_t, 16> column_cases_lo = make_column_cases(simd::row_case_bit_lo);
+constexpr std::array<uint8_t, 16> column_cases_hi = make_column_cases(simd::row_case_bit_hi);
+
+// If the y-edge on row dz, or the z-edge on row dy, of a column of corners is crossed
+inline uint32_t column_crosses_y(const int column, const size_t dz) {
+	return ((column >> (2 * dz)) ^ (column >> (2 * dz + 1))) & 1;
+}
+
+inline uint32_t column_crosses_z(const int column, const size_t dy) {
+	return ((column >> dy) ^ (column >> (dy + 2))) & 1;
+}
+
+// The mask of which of the 4 rows of a column of corners are inside the surface at x
+template<typename T>
+int column_inside(const T *const rows[4], const size_t x, const iso_threshold_t<T> threshold) {
+	return (rows[0][x] <= threshold) | (rows[1][x] <= threshold) << 1
+		| (rows[2][x] <= threshold) << 2 | (rows[3][x] <= threshold) << 3;
+}
+
+// The position of the vertex on the edge from voxel to voxel + 1 along the axis. It's
+// computed from the cell owning the edge as extract_indexed_mesh does, so the two produce
+// bitwise identical vertices.
+inline vec3f edge_vertex(const vec3sz &dims, const vec3sz &voxel, const size_t axis, const float fa,
+		const float fb, const float isovalue)
+{
+	vec3sz owner = voxel;
+	vec3i va = {0, 0, 0};
+	for (size_t a = 0; a < 3; ++a) {
+		if (a != axis && owner[a] > dims[a] - 2) {
+			owner[a] = dims[a] - 2;
+			va[a] = 1;
+		}
+	}
+	vec3i vb = va;
+	vb[axis] += 1;
+	const vec3f p = lerp_verts(va, vb, fa, fb, isovalue);
+	return {p[0] + owner[0] + 0.5f, p[1] + owner[1] + 0.5f, p[2] + owner[2] + 0.5f};
+}
+
+}
+
+// The classification and counts of an x-row of voxels. Voxels [0, xl] are all on the same
+// side of the surface as voxel 0, and voxels [xr, dims[0]) all on the side of the last
+// voxel, so the surface can only cross the row's edges between xl and xr.
+struct FlyingEdgesRow {
+	size_t xl = 0;
+	size_t xr = 0;
+	bool left_inside = false;
+	bool right_inside = false;
+	// The crossings of the x, y and z-edges starting on the row, and the triangles of the row
+	// of cells starting on it
+	size_t num_x = 0;
+	size_t num_y = 0;
+	size_t num_z = 0;
+	size_t num_tris = 0;
+	// The range of cells of the cell row which may be crossed by the surface
+	size_t cell_begin = 0;
+	size_t cell_end = 0;
+};
+
+// Buffers used by flying_edges_marching_cubes, which can be kept to reuse their memory in
+// later calls
+struct FlyingEdgesWorkspace {
+	std::vector<FlyingEdgesRow> rows;
+	std::vector<uint64_t> vertex_offsets;
+	std::vector<uint64_t> tri_offsets;
+
+	size_t bytes() const {
+		return rows.capacity() * sizeof(FlyingEdgesRow)
+			+ (vertex_offsets.capacity() + tri_offsets.capacity()) * sizeof(uint64_t);
+	}
+
+	void release() {
+		*this = FlyingEdgesWorkspace();
+	}
+};
+
+// Compute an indexed mesh of the isosurface with Flying Edges, see above. The indices are of
+// type I, and std::overflow_error is thrown if there are more vertices than I can index.
+template<typename T, typename I>
+void flying_edges_marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<vec3f> &vertices, std::vector<I> &indices,
+		FlyingEdgesWorkspace &workspace, const ScanBackend scan_backend = ScanBackend::TBB,
+		ExtractionStats *stats = nullptr)
+{
+	const iso_threshold_t<T> threshold = iso_threshold<T>(isovalue);
+	const size_t nx = dims[0];
+	const size_t num_rows = dims[1] * dims[2];
+	auto row_index = [&](const size_t j, const size_t k) {
+		return k * dims[1] + j;
+	};
+	auto row_values = [&](const size_t r) {
+		return volume.data() + r * nx;
+	};
+	auto &rows = workspace.rows;
+
+	// Pass 1: classify the voxels of each row and trim it to its x-edge crossings
+	StageTimer classify_timer(stats, "classify_x_edges");
+	rows.resize(num_rows);
+	counted_parallel_for(num_rows, stats,
+		[&](const size_t r) {
+			const T *values = row_values(r);
+			FlyingEdgesRow &row = rows[r];
+			row = FlyingEdgesRow();
+			row.xl = nx - 1;
+			row.left_inside = values[0] <= threshold;
+			row.right_inside = values[nx - 1] <= threshold;
+			bool inside = row.left_inside;
+			for (size_t x = 0; x + 1 < nx; ++x) {
+				const bool next_inside = values[x + 1] <= threshold;
+				if (inside != next_inside) {
+					row.xl = std::min(row.xl, x);
+					row.xr = x + 1;
+					++row.num_x;
+				}
+				inside = next_inside;
+			}
+		});
+	classify_timer.stop(rows.size() * sizeof(FlyingEdgesRow));
+
+	// Pass 2: count the y and z-edge crossings and triangles of each row. The crossings
+	// between two rows can only lie outside their trim ranges if the rows' sides of the
+	// surface differ there, in which case the range is extended to the end of the row.
+	StageTimer count_timer(stats, "count");
+	auto edge_range = [&](const FlyingEdgesRow &a, const FlyingEdgesRow &b, size_t &begin, size_t &end) {
+		begin = a.left_inside == b.left_inside ? std::min(a.xl, b.xl) : 0;
+		end = a.right_inside == b.right_inside ? std::max(a.xr, b.xr) + 1 : nx;
+		end = std::min(end, nx);
+	};
+	counted_parallel_for(num_rows, stats,
+		[&](const size_t r) {
+			const size_t j = r % dims[1];
+			const size_t k = r / dims[1];
+			FlyingEdgesRow &row = rows[r];
+			const T *values = row_values(r);
+			size_t begin = 0;
+			size_t end = 0;
+			if (j + 1 < dims[1]) {
+				const T *next = row_values(row_index(j + 1, k));
+				edge_range(row, rows[row_index(j + 1, k)], begin, end);
+				for (size_t x = begin; x < end; ++x) {
+					row.num_y += (values[x] <= threshold) != (next[x] <= threshold);
+				}
+			}
+			if (k + 1 < dims[2]) {
+				const T *next = row_values(row_index(j, k + 1));
+				edge_range(row, rows[row_index(j, k + 1)], begin, end);
+				for (size_t x = begin; x < end; ++x) {
+					row.num_z += (values[x] <= threshold) != (next[x] <= threshold);
+				}
+			}
+			if (j + 1 < dims[1] && k + 1 < dims[2]) {
+				const FlyingEdgesRow *corners[4] = {&row, &rows[row_index(j + 1, k)],
+					&rows[row_index(j, k + 1)], &rows[row_index(j + 1, k + 1)]};
+				const T *corner_values[4];
+				bool left_same = true;
+				bool right_same = true;
+				row.cell_begin = nx - 1;
+				row.cell_end = 0;
+				for (size_t c = 0; c < 4; ++c) {
+					corner_values[c] = row_values(corners[c] - rows.data());
+					left_same = left_same && corners[c]->left_inside == row.left_inside;
+					right_same = right_same && corners[c]->right_inside == row.right_inside;
+					row.cell_begin = std::min(row.cell_begin, corners[c]->xl);
+					row.cell_end = std::max(row.cell_end, corners[c]->xr);
+				}
+				if (!left_same) {
+					row.cell_begin = 0;
+				}
+				row.cell_end = right_same ? std::min(row.cell_end, nx - 1) : nx - 1;
+				// Each column of corners is the hi side of one cell and the lo side of the next
+				int lo = detail::column_inside(corner_values, row.cell_begin, threshold);
+				for (size_t x = row.cell_begin; x < row.cell_end; ++x) {
+					const int hi = detail::column_inside(corner_values, x + 1, threshold);
+					row.num_tris += case_num_verts[detail::column_cases_lo[lo] | detail::column_cases_hi[hi]] / 3;
+					lo = hi;
+				}
+			}
+		});
+	count_timer.stop();
+
+	// Pass 3: the vertices of each row are its x, then y, then z-edge crossings
+	StageTimer scan_timer(stats, "scan");
+	auto &vertex_offsets = workspace.vertex_offsets;
+	auto &tri_offsets = workspace.tri_offsets;
+	vertex_offsets.resize(num_rows);
+	tri_offsets.resize(num_rows);
+	tbb::parallel_for(size_t(0), num_rows,
+		[&](const size_t r) {
+			vertex_offsets[r] = rows[r].num_x + rows[r].num_y + rows[r].num_z;
+			tri_offsets[r] = rows[r].num_tris;
+		});
+	const uint64_t total_verts = ::exclusive_scan(vertex_offsets.data(), vertex_offsets.data() + num_rows,
+			vertex_offsets.data(), uint64_t(0), std::plus<uint64_t>{}, scan_backend);
+	const uint64_t total_tris = ::exclusive_scan(tri_offsets.data(), tri_offsets.data() + num_rows,
+			tri_offsets.data(), uint64_t(0), std::plus<uint64_t>{}, scan_backend);
+	scan_timer.stop(num_rows * 2 * sizeof(uint64_t));
+	if (total_verts > std::numeric_limits<I>::max()) {
+		throw std::overflow_error("The indexed mesh has " + std::to_string(total_verts)
+				+ " vertices, which is more than its index type can address");
+	}
+
+	// Pass 4: interpolate the crossings of each row, and generate the triangles of each row
+	// of cells
+	StageTimer generate_timer(stats, "generate");
+	vertices.resize(total_verts);
+	indices.resize(total_tris * 3);
+	counted_parallel_for(num_rows, stats,
+		[&](const size_t r) {
+			const size_t j = r % dims[1];
+			const size_t k = r / dims[1];
+			const FlyingEdgesRow &row = rows[r];
+			const T *values = row_values(r);
+			uint64_t out = vertex_offsets[r];
+			for (size_t x = row.xl; x < row.xr; ++x) {
+				if ((values[x] <= threshold) != (values[x + 1] <= threshold)) {
+					vertices[out++] = detail::edge_vertex(dims, {x, j, k}, 0, values[x], values[x + 1], isovalue);
+				}
+			}
+			size_t begin = 0;
+			size_t end = 0;
+			for (size_t axis = 1; axis < 3; ++axis) {
+				const vec3sz next_voxel = {0, j + (axis == 1), k + (axis == 2)};
+				if (next_voxel[1] == dims[1] || next_voxel[2] == dims[2]) {
+					continue;
+				}
+				const size_t next = row_index(next_voxel[1], next_voxel[2]);
+				const T *next_values = row_values(next);
+				edge_range(row, rows[next], begin, end);
+				for (size_t x = begin; x < end; ++x) {
+					if ((values[x] <= threshold) != (next_values[x] <= threshold)) {
+						vertices[out++] = detail::edge_vertex(dims, {x, j, k}, axis, values[x], next_values[x],
+								isovalue);
+					}
+				}
+			}
+
+			if (j + 1 == dims[1] || k + 1 == dims[2] || row.num_tris == 0) {
+				return;
+			}
+			// The vertex offsets of the edge rows around the cell row, which are advanced by
+			// the running count of each row's crossings as we walk along x
+			const size_t corner_rows[4] = {r, row_index(j + 1, k), row_index(j, k + 1), row_index(j + 1, k + 1)};
+			const T *corner_values[4];
+			uint64_t x_ids[4];
+			for (size_t c = 0; c < 4; ++c) {
+				corner_values[c] = row_values(corner_rows[c]);
+				x_ids[c] = vertex_offsets[corner_rows[c]];
+			}
+			uint64_t y_ids[2] = {vertex_offsets[corner_rows[0]] + rows[corner_rows[0]].num_x,
+				vertex_offsets[corner_rows[2]] + rows[corner_rows[2]].num_x};
+			uint64_t z_ids[2] = {y_ids[0] + rows[corner_rows[0]].num_y,
+				vertex_offsets[corner_rows[1]] + rows[corner_rows[1]].num_x + rows[corner_rows[1]].num_y};
+
+			uint64_t tri_out = tri_offsets[r] * 3;
+			int lo = detail::column_inside(corner_values, row.cell_begin, threshold);
+			for (size_t x = row.cell_begin; x < row.cell_end; ++x) {
+				const int hi = detail::column_inside(corner_values, x + 1, threshold);
+				const uint8_t cube_case = detail::column_cases_lo[lo] | detail::column_cases_hi[hi];
+				const size_t edges_begin = case_edge_offsets[cube_case];
+				for (size_t t = 0; t < case_num_verts[cube_case]; ++t) {
+					const detail::FlyingEdgesEdge &e = detail::flying_edges_edges[case_edges[edges_begin + t]];
+					uint64_t id = 0;
+					if (e.axis == 0) {
+						id = x_ids[e.row];
+					} else if (e.axis == 1) {
+						id = y_ids[e.row] + (e.dx ? detail::column_crosses_y(lo, e.row) : 0);
+					} else {
+						id = z_ids[e.row] + (e.dx ? detail::column_crosses_z(lo, e.row) : 0);
+					}
+					indices[tri_out++] = I(id);
+				}
+				const int crossed_x = lo ^ hi;
+				for (size_t c = 0; c < 4; ++c) {
+					x_ids[c] += (crossed_x >> c) & 1;
+				}
+				for (size_t d = 0; d < 2; ++d) {
+					y_ids[d] += detail::column_crosses_y(lo, d);
+					z_ids[d] += detail::column_crosses_z(lo, d);
+				}
+				lo = hi;
+			}
+		});
+	generate_timer.stop(vertices.size() * sizeof(vec3f) + indices.size() * sizeof(I));
+	STATS_RECORD(stats, vertices += vertices.size());
+	STATS_RECORD(stats, indices += indices.size());
+	STATS_RECORD(stats, freed(workspace.bytes()));
+}
+
+// Compute an indexed mesh of the isosurface with Flying Edges using temporary buffers
+template<typename T, typename I>
+void flying_edges_marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<vec3f> &vertices, std::vector<I> &indices,
+		const ScanBackend scan_backend = ScanBackend::TBB, ExtractionStats *stats = nullptr)
+{
+	FlyingEdgesWorkspace workspace;
+	flying_edges_marching_cubes(volume, dims, isovalue, vertices, indices, workspace, scan_backend, stats);
+}
@@ -36,6 +36,17 @@ int main(int argc, char **argv) {
 	}
 	std::cout << "\n";
 
+	// The iterator overloads don't allocate and can scan in place
+	std::vector<int> in_place = data;
+	int in_place_sum = exclusive_scan(in_place.begin(), in_place.end(), in_place.begin(),
+			0, std::plus<int>(), ScanBackend::DECOUPLED_LOOKBACK);
+	std::cout << "In Place Exclusive Sum: " << in_place_sum << "\n"
+		<< "In Place Exclusive Scan results:\n";
+	for (const auto &r : in_place) {
+		std::cout << r << ", ";
+	}
+	std::cout << "\n";
+
 	return 0;
 }
 
@@ -1,601 +1,631 @@
-#include <array>
-#include <random>
 #include <chrono>
 #include <fstream>
-#include <cmath>
 #include <iostream>
-#include <tbb/parallel_for.h>
-#include "scan.h"
+#include <memory>
+#include <random>
+#include <sstream>
+#include <tbb/scalable_allocator.h>
+#include "bricked_volume.h"
+#include "flying_edges.h"
+#include "marching_cubes.h"
+#include "mesh_io.h"
+#include "mc_server.h"
 
 using namespace std::chrono;
 
-// Edge and triangle tables for the cases of marching cubes
-// From http://paulbourke.net/geometry/polygonise/ and
-// https://graphics.stanford.edu/~mdfisher/MarchingCubes.html
-const std::array<std::array<int, 16>, 256> tri_table = {
-	std::array<int, 16>{-1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  9,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  1,  9,  8,  3,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2, 10,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  2, 10,  9,  0,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  2, 10,  3, 10,  8,  8, 10,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  3, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  0,  8, 11,  2,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  9,  0,  2,  3, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  1,  9,  2,  9, 11, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3, 10,  1,  3, 11, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  0,  8,  1,  8, 10, 10,  8, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  3, 11,  0, 11,  9,  9, 11, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11, 10,  9, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  3,  0,  4,  7,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  8,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  4,  7,  9,  7,  1,  1,  7,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  8,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  3,  0,  4,  7,  3,  2, 10,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  9,  0,  2, 10,  9,  4,  7,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  2,  7,  7,  9,  4,  7,  2,  9,  9,  2, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 8,  4,  7,  3, 11,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7, 11,  2,  7,  2,  4,  4,  2,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  3, 11,  1,  9,  0,  8,  4,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  1,  9,  2,  9,  4,  2,  4, 11, 11,  4,  7, -1,  0,  0,  0},
-	std::array<int, 16>{10,  3, 11, 10,  1,  3,  8,  4,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  0,  0, 10,  1,  7, 10,  0,  7, 11, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 8,  4,  7,  0,  3, 11,  0, 11,  9,  9, 11, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  9,  4,  7, 11,  9,  9, 11, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  9,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  3,  0,  4,  9,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  5,  4,  0,  1,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  8,  3,  4,  3,  5,  5,  3,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  2, 10,  9,  5,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  9,  5,  8,  3,  0,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  5,  4, 10,  4,  2,  2,  4,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  8,  3,  4,  3,  2,  4,  2,  5,  5,  2, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  3, 11,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  0,  8, 11,  2,  0,  9,  5,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 5,  0,  1,  5,  4,  0,  3, 11,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  2,  8,  8,  5,  4,  2,  5,  8,  2,  1,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 3, 10,  1,  3, 11, 10,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  5,  4,  1,  0,  8,  1,  8, 10, 10,  8, 11, -1,  0,  0,  0},
-	std::array<int, 16>{10,  5, 11, 11,  0,  3, 11,  5,  0,  0,  5,  4, -1,  0,  0,  0},
-	std::array<int, 16>{ 4, 10,  5,  4,  8, 10, 10,  8, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  9,  5,  7,  8,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  9,  5,  0,  5,  3,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  0,  1,  8,  1,  7,  7,  1,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  1,  5,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  9,  5,  7,  8,  9,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  2, 10,  0,  9,  5,  0,  5,  3,  3,  5,  7, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  8,  5,  5,  2, 10,  8,  2,  5,  8,  0,  2, -1,  0,  0,  0},
-	std::array<int, 16>{10,  3,  2, 10,  5,  3,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  7,  8,  9,  5,  7, 11,  2,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  9,  2,  2,  7, 11,  2,  9,  7,  7,  9,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 3, 11,  2,  8,  0,  1,  8,  1,  7,  7,  1,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  7, 11,  2,  1,  7,  7,  1,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  1,  3, 11, 10,  1,  7,  8,  9,  7,  9,  5, -1,  0,  0,  0},
-	std::array<int, 16>{11, 10,  1, 11,  1,  7,  7,  1,  0,  7,  0,  9,  7,  9,  5, -1},
-	std::array<int, 16>{ 5,  7,  8,  5,  8, 10, 10,  8,  0, 10,  0,  3, 10,  3, 11, -1},
-	std::array<int, 16>{11, 10,  5, 11,  5,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  0,  1,  5, 10,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  1,  9,  8,  3,  1, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  1,  2,  6,  5,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  1,  2,  6,  5,  1,  0,  8,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 5,  9,  0,  5,  0,  6,  6,  0,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  5,  2,  2,  8,  3,  5,  8,  2,  5,  9,  8, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  3, 11, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0, 11,  2,  0,  8, 11,  6,  5, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  1,  9,  3, 11,  2, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  6,  5,  2,  1,  9,  2,  9, 11, 11,  9,  8, -1,  0,  0,  0},
-	std::array<int, 16>{11,  6,  5, 11,  5,  3,  3,  5,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  6,  8,  8,  1,  0,  8,  6,  1,  1,  6,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  3, 11,  0, 11,  6,  0,  6,  9,  9,  6,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 5, 11,  6,  5,  9, 11, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  8,  4,  6,  5, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  4,  7,  3,  0,  4,  5, 10,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  5, 10,  7,  8,  4,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 5, 10,  6,  9,  4,  7,  9,  7,  1,  1,  7,  3, -1,  0,  0,  0},
-	std::array<int, 16>{ 1,  6,  5,  1,  2,  6,  7,  8,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  0,  4,  7,  3,  0,  6,  5,  1,  6,  1,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  8,  5,  9,  0,  5,  0,  6,  6,  0,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  6,  5,  2,  5,  3,  3,  5,  9,  3,  9,  4,  3,  4,  7, -1},
-	std::array<int, 16>{ 4,  7,  8,  5, 10,  6, 11,  2,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  5, 10,  7, 11,  2,  7,  2,  4,  4,  2,  0, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  7,  8,  9,  0,  1,  6,  5, 10,  3, 11,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 6,  5, 10, 11,  4,  7, 11,  2,  4,  4,  2,  9,  9,  2,  1, -1},
-	std::array<int, 16>{ 7,  8,  4, 11,  6,  5, 11,  5,  3,  3,  5,  1, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  4,  7,  0,  7,  1,  1,  7, 11,  1, 11,  6,  1,  6,  5, -1},
-	std::array<int, 16>{ 4,  7,  8,  9,  6,  5,  9,  0,  6,  6,  0, 11, 11,  0,  3, -1},
-	std::array<int, 16>{ 7, 11,  4, 11,  9,  4, 11,  5,  9, 11,  6,  5, -1,  0,  0,  0},
-	std::array<int, 16>{10,  4,  9, 10,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  4,  9, 10,  6,  4,  8,  3,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1, 10,  6,  1,  6,  0,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  8,  6,  6,  1, 10,  6,  8,  1,  1,  8,  3, -1,  0,  0,  0},
-	std::array<int, 16>{ 9,  1,  2,  9,  2,  4,  4,  2,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3,  9,  1,  2,  9,  2,  4,  4,  2,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  2,  6,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  4,  8,  3,  2,  4,  4,  2,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4, 10,  6,  4,  9, 10,  2,  3, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  2,  0,  8, 11,  2,  4,  9, 10,  4, 10,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  3, 11,  1, 10,  6,  1,  6,  0,  0,  6,  4, -1,  0,  0,  0},
-	std::array<int, 16>{ 8, 11,  2,  8,  2,  4,  4,  2,  1,  4,  1, 10,  4, 10,  6, -1},
-	std::array<int, 16>{ 3, 11,  1,  1,  4,  9, 11,  4,  1, 11,  6,  4, -1,  0,  0,  0},
-	std::array<int, 16>{ 6,  4,  9,  6,  9, 11, 11,  9,  1, 11,  1,  0, 11,  0,  8, -1},
-	std::array<int, 16>{11,  0,  3, 11,  6,  0,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8, 11,  6,  8,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  7,  8,  6,  8, 10, 10,  8,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  0,  7,  7, 10,  6,  0, 10,  7,  0,  9, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 1, 10,  6,  1,  6,  7,  1,  7,  0,  0,  7,  8, -1,  0,  0,  0},
-	std::array<int, 16>{ 6,  1, 10,  6,  7,  1,  1,  7,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  1,  8,  8,  6,  7,  8,  1,  6,  6,  1,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  3,  0,  7,  0,  6,  6,  0,  9,  6,  9,  1,  6,  1,  2, -1},
-	std::array<int, 16>{ 8,  6,  7,  8,  0,  6,  6,  0,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  6,  7,  2,  7,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  2,  3,  6,  7,  8,  6,  8, 10, 10,  8,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 9, 10,  6,  9,  6,  0,  0,  6,  7,  0,  7, 11,  0, 11,  2, -1},
-	std::array<int, 16>{ 3, 11,  2,  0,  7,  8,  0,  1,  7,  7,  1,  6,  6,  1, 10, -1},
-	std::array<int, 16>{ 6,  7, 10,  7,  1, 10,  7,  2,  1,  7, 11,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 1,  3, 11,  1, 11,  9,  9, 11,  6,  9,  6,  7,  9,  7,  8, -1},
-	std::array<int, 16>{ 6,  7, 11,  9,  1,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  0,  7,  0,  6,  7,  0, 11,  6,  0,  3, 11, -1,  0,  0,  0},
-	std::array<int, 16>{ 6,  7, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6, 11,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  0,  8, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6, 11,  7,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  8,  3,  1,  9,  8,  7,  6, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  7,  6,  2, 10,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  2, 10,  0,  8,  3, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  2, 10,  9,  0,  2, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  7,  6,  3,  2, 10,  3, 10,  8,  8, 10,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  7,  6,  2,  3,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  7,  6,  8,  6,  0,  0,  6,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  2,  3,  7,  6,  2,  1,  9,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  7,  9,  9,  2,  1,  9,  7,  2,  2,  7,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 6, 10,  1,  6,  1,  7,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6, 10,  1,  6,  1,  0,  6,  0,  7,  7,  0,  8, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  6,  3,  3,  9,  0,  6,  9,  3,  6, 10,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 6,  8,  7,  6, 10,  8,  8, 10,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  6, 11,  8,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  3,  0, 11,  0,  6,  6,  0,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  8,  4,  6, 11,  8,  0,  1,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  9,  3,  3,  6, 11,  9,  6,  3,  9,  4,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 8,  6, 11,  8,  4,  6, 10,  1,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2, 10,  1, 11,  3,  0, 11,  0,  6,  6,  0,  4, -1,  0,  0,  0},
-	std::array<int, 16>{11,  4,  6, 11,  8,  4,  2, 10,  9,  2,  9,  0, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  6, 11,  4, 11,  9,  9, 11,  3,  9,  3,  2,  9,  2, 10, -1},
-	std::array<int, 16>{ 3,  8,  4,  3,  4,  2,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  0,  4,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  1,  9,  3,  8,  4,  3,  4,  2,  2,  4,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 9,  2,  1,  9,  4,  2,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6, 10,  4,  4,  3,  8,  4, 10,  3,  3, 10,  1, -1,  0,  0,  0},
-	std::array<int, 16>{ 1,  6, 10,  1,  0,  6,  6,  0,  4, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  9,  0, 10,  0,  6,  6,  0,  3,  6,  3,  8,  6,  8,  4, -1},
-	std::array<int, 16>{10,  9,  4, 10,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6, 11,  7,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3,  9,  5,  4,  7,  6, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  5,  4,  0,  1,  5,  6, 11,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  6, 11,  4,  8,  3,  4,  3,  5,  5,  3,  1, -1,  0,  0,  0},
-	std::array<int, 16>{ 2, 10,  1, 11,  7,  6,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3,  1,  2, 10,  4,  9,  5, 11,  7,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 6, 11,  7, 10,  5,  4, 10,  4,  2,  2,  4,  0, -1,  0,  0,  0},
-	std::array<int, 16>{ 6, 11,  7,  5,  2, 10,  5,  4,  2,  2,  4,  3,  3,  4,  8, -1},
-	std::array<int, 16>{ 2,  7,  6,  2,  3,  7,  4,  9,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  9,  5,  8,  7,  6,  8,  6,  0,  0,  6,  2, -1,  0,  0,  0},
-	std::array<int, 16>{ 3,  6,  2,  3,  7,  6,  0,  1,  5,  0,  5,  4, -1,  0,  0,  0},
-	std::array<int, 16>{ 1,  5,  4,  1,  4,  2,  2,  4,  8,  2,  8,  7,  2,  7,  6, -1},
-	std::array<int, 16>{ 5,  4,  9,  6, 10,  1,  6,  1,  7,  7,  1,  3, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  9,  5,  7,  0,  8,  7,  6,  0,  0,  6,  1,  1,  6, 10, -1},
-	std::array<int, 16>{ 3,  7,  6,  3,  6,  0,  0,  6, 10,  0, 10,  5,  0,  5,  4, -1},
-	std::array<int, 16>{ 4,  8,  5,  8, 10,  5,  8,  6, 10,  8,  7,  6, -1,  0,  0,  0},
-	std::array<int, 16>{ 5,  6, 11,  5, 11,  9,  9, 11,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  9,  5,  0,  5,  6,  0,  6,  3,  3,  6, 11, -1,  0,  0,  0},
-	std::array<int, 16>{ 8,  0, 11, 11,  5,  6, 11,  0,  5,  5,  0,  1, -1,  0,  0,  0},
-	std::array<int, 16>{11,  5,  6, 11,  3,  5,  5,  3,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  1,  2,  5,  6, 11,  5, 11,  9,  9, 11,  8, -1,  0,  0,  0},
-	std::array<int, 16>{ 2, 10,  1,  3,  6, 11,  3,  0,  6,  6,  0,  5,  5,  0,  9, -1},
-	std::array<int, 16>{ 0,  2, 10,  0, 10,  8,  8, 10,  5,  8,  5,  6,  8,  6, 11, -1},
-	std::array<int, 16>{11,  3,  6,  3,  5,  6,  3, 10,  5,  3,  2, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  3,  6,  6,  9,  5,  3,  9,  6,  3,  8,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 5,  0,  9,  5,  6,  0,  0,  6,  2, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 6,  2,  3,  6,  3,  5,  5,  3,  8,  5,  8,  0,  5,  0,  1, -1},
-	std::array<int, 16>{ 6,  2,  1,  6,  1,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  9,  5,  8,  5,  3,  3,  5,  6,  3,  6, 10,  3, 10,  1, -1},
-	std::array<int, 16>{ 1,  0, 10,  0,  6, 10,  0,  5,  6,  0,  9,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  3,  8, 10,  5,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{10,  5,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  5, 10, 11,  7,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 5, 11,  7,  5, 10, 11,  3,  0,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  5, 10, 11,  7,  5,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  3,  1,  9,  8,  3,  5, 10, 11,  5, 11,  7, -1,  0,  0,  0},
-	std::array<int, 16>{ 2, 11,  7,  2,  7,  1,  1,  7,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  0,  8,  2, 11,  7,  2,  7,  1,  1,  7,  5, -1,  0,  0,  0},
-	std::array<int, 16>{ 2, 11,  0,  0,  5,  9,  0, 11,  5,  5, 11,  7, -1,  0,  0,  0},
-	std::array<int, 16>{ 9,  8,  3,  9,  3,  5,  5,  3,  2,  5,  2, 11,  5, 11,  7, -1},
-	std::array<int, 16>{10,  2,  3, 10,  3,  5,  5,  3,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 5, 10,  7,  7,  0,  8, 10,  0,  7, 10,  2,  0, -1,  0,  0,  0},
-	std::array<int, 16>{ 1,  9,  0, 10,  2,  3, 10,  3,  5,  5,  3,  7, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  5, 10,  7, 10,  8,  8, 10,  2,  8,  2,  1,  8,  1,  9, -1},
-	std::array<int, 16>{ 7,  5,  1,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  1,  0,  8,  7,  1,  1,  7,  5, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  5,  9,  0,  3,  5,  5,  3,  7, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  5,  9,  7,  9,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  5, 10,  4, 10,  8,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{11,  3, 10, 10,  4,  5, 10,  3,  4,  4,  3,  0, -1,  0,  0,  0},
-	std::array<int, 16>{ 9,  0,  1,  4,  5, 10,  4, 10,  8,  8, 10, 11, -1,  0,  0,  0},
-	std::array<int, 16>{ 3,  1,  9,  3,  9, 11, 11,  9,  4, 11,  4,  5, 11,  5, 10, -1},
-	std::array<int, 16>{ 8,  4, 11, 11,  1,  2,  4,  1, 11,  4,  5,  1, -1,  0,  0,  0},
-	std::array<int, 16>{ 5,  1,  2,  5,  2,  4,  4,  2, 11,  4, 11,  3,  4,  3,  0, -1},
-	std::array<int, 16>{11,  8,  4, 11,  4,  2,  2,  4,  5,  2,  5,  9,  2,  9,  0, -1},
-	std::array<int, 16>{ 2, 11,  3,  5,  9,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  5, 10,  4, 10,  2,  4,  2,  8,  8,  2,  3, -1,  0,  0,  0},
-	std::array<int, 16>{10,  4,  5, 10,  2,  4,  4,  2,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  1,  9,  8,  2,  3,  8,  4,  2,  2,  4, 10, 10,  4,  5, -1},
-	std::array<int, 16>{10,  2,  5,  2,  4,  5,  2,  9,  4,  2,  1,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  3,  8,  4,  5,  3,  3,  5,  1, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  4,  5,  0,  5,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  3,  9,  3,  5,  9,  3,  4,  5,  3,  8,  4, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  5,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  4,  9,  7,  9, 11, 11,  9, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  3,  0,  7,  4,  9,  7,  9, 11, 11,  9, 10, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  1,  4,  4, 11,  7,  1, 11,  4,  1, 10, 11, -1,  0,  0,  0},
-	std::array<int, 16>{10, 11,  7, 10,  7,  1,  1,  7,  4,  1,  4,  8,  1,  8,  3, -1},
-	std::array<int, 16>{ 2, 11,  7,  2,  7,  4,  2,  4,  1,  1,  4,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 0,  8,  3,  1,  4,  9,  1,  2,  4,  4,  2,  7,  7,  2, 11, -1},
-	std::array<int, 16>{ 7,  2, 11,  7,  4,  2,  2,  4,  0, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 7,  4, 11,  4,  2, 11,  4,  3,  2,  4,  8,  3, -1,  0,  0,  0},
-	std::array<int, 16>{ 7,  4,  3,  3, 10,  2,  3,  4, 10, 10,  4,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  0,  8,  2,  8, 10, 10,  8,  7, 10,  7,  4, 10,  4,  9, -1},
-	std::array<int, 16>{ 4,  0,  1,  4,  1,  7,  7,  1, 10,  7, 10,  2,  7,  2,  3, -1},
-	std::array<int, 16>{ 4,  8,  7,  1, 10,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9,  7,  4,  9,  1,  7,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  7,  0,  7,  1,  0,  7,  9,  1,  7,  4,  9, -1,  0,  0,  0},
-	std::array<int, 16>{ 4,  0,  3,  4,  3,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 4,  8,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  9, 10,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0, 11,  3,  0,  9, 11, 11,  9, 10, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  8,  0,  1, 10,  8,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  1, 10,  3, 10, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2,  9,  1,  2, 11,  9,  9, 11,  8, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  9,  3,  9, 11,  3,  9,  2, 11,  9,  1,  2, -1,  0,  0,  0},
-	std::array<int, 16>{11,  8,  0, 11,  0,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 2, 11,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3, 10,  2,  3,  8, 10, 10,  8,  9, -1,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 9, 10,  2,  9,  2,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 3,  8,  2,  8, 10,  2,  8,  1, 10,  8,  0,  1, -1,  0,  0,  0},
-	std::array<int, 16>{ 2,  1, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 8,  9,  1,  8,  1,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 1,  0,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{ 0,  3,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-	std::array<int, 16>{-1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+// The voxel types of volume files we can extract from
+enum class VoxelType {
+	UINT8,
+	UINT16,
+	INT16,
+	FLOAT32
 };
 
-const std::array<std::array<int, 2>, 12> edge_vertices = {
-	std::array<int, 2>{0, 1},
-	std::array<int, 2>{1, 2},
-	std::array<int, 2>{2, 3},
-	std::array<int, 2>{3, 0},
-	std::array<int, 2>{4, 5},
-	std::array<int, 2>{6, 5},
-	std::array<int, 2>{6, 7},
-	std::array<int, 2>{7, 4},
-	std::array<int, 2>{0, 4},
-	std::array<int, 2>{1, 5},
-	std::array<int, 2>{2, 6},
-	std::array<int, 2>{3, 7},
+bool parse_voxel_type(const std::string &name, VoxelType &type) {
+	if (name == "uint8") {
+		type = VoxelType::UINT8;
+	} else if (name == "uint16") {
+		type = VoxelType::UINT16;
+	} else if (name == "int16") {
+		type = VoxelType::INT16;
+	} else if (name == "float32") {
+		type = VoxelType::FLOAT32;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// A volume loaded by the server
+struct VolumeSpec {
+	std::string fname;
+	vec3sz dims = {0};
+	VoxelType type = VoxelType::UINT8;
 };
 
-using vec3sz = std::array<size_t, 3>;
-using vec3f = std::array<float, 3>;
-using vec2f = std::array<float, 2>;
-using vec3i = std::array<int, 3>;
-
-const std::array<vec3i, 8> index_to_vertex = {
-	vec3i{0, 0, 0},
-	vec3i{1, 0, 0},
-	vec3i{1, 1, 0},
-	vec3i{0, 1, 0},
-	vec3i{0, 0, 1},
-	vec3i{1, 0, 1},
-	vec3i{1, 1, 1},
-	vec3i{0, 1, 1},
+struct Options {
+	std::string fname;
+	std::string output;
+	MeshFormat mesh_format = MeshFormat::OBJ;
+	vec3sz dims = {0};
+	float isovalue = 0;
+	// Isovalues extracted together by the batch extraction, if given
+	std::vector<float> batch_isovalues;
+	size_t benchmark_iters = 1;
+	vec2f bench_range = {0};
+	uint32_t bench_seed = 5489;
+	// Where to write the extraction stats JSON, - for stdout
+	std::string stats_output;
+	// Cap on the memory kept by the extraction workspaces between runs, 0 for no cap
+	size_t workspace_cap_mb = 0;
+	bool serial = false;
+	ScanBackend scan_backend = ScanBackend::TBB;
+	size_t macrocell_size = 0;
+	// Brick size of the bricked layout the volume is converted to, 0 to keep it row major
+	size_t brick_size = 0;
+	bool span_space = false;
+	// Step of the isovalue between the incremental extractions, if running them
+	float incremental_step = 0;
+	bool incremental = false;
+	bool indexed = false;
+	bool flying_edges = false;
+	size_t stream_budget_mb = 0;
+	// Memory budget of the pipelined extraction, 0 to not run it
+	size_t pipeline_budget_mb = 0;
+	// Socket path the server listens on, - for stdin/stdout, empty to not run the server
+	std::string serve;
+	// Volumes loaded by the server in addition to the one given by -f
+	std::vector<VolumeSpec> serve_volumes;
 };
 
-// Compute the vertex values of the cell given the ID of its bottom vertex
-void compute_vertex_values(const std::vector<uint8_t> &volume, const vec3sz &dims, const vec3sz &cell,
-		std::array<float, 8> &values)
+// Slabs in flight in the pipelined extraction, one being read, one extracted and one written
+const size_t pipeline_slabs = 3;
+
+// Extract the batch of isovalues from the volume, writing a mesh per isovalue
+template<typename T>
+int run_batch_extraction(const Options &opts, const VolumeSource<T> &volume,
+		const MacrocellGrid<T> *grid)
 {
-	for (size_t i = 0; i < index_to_vertex.size(); ++i) {
-		const auto &v = index_to_vertex[i];
-		// We want to swap the order we go when on the top of the cube,
-		// due to how the indices are labeled in the paper.
-		size_t voxel = ((cell[2] + v[2]) * dims[1] + cell[1] + v[1]) * dims[0] + cell[0] + v[0];
-		values[i] = volume[voxel];
-	};
-}
+	const std::vector<float> &isovalues = opts.batch_isovalues;
+	std::vector<std::vector<vec3f>> meshes;
+	std::unique_ptr<ExtractionStats> stats;
+	if (!opts.stats_output.empty()) {
+		stats = std::make_unique<ExtractionStats>();
+	}
+	auto start = high_resolution_clock::now();
+	batch_marching_cubes(volume, opts.dims, isovalues, meshes, opts.scan_backend, grid, stats.get());
+	auto end = high_resolution_clock::now();
+	size_t num_tris = 0;
+	for (const auto &m : meshes) {
+		num_tris += m.size() / 3;
+	}
+	std::cout << isovalues.size() << " isosurfaces with " << num_tris << " triangles computed in "
+		<< duration_cast<milliseconds>(end - start).count() << "ms (batch)\n";
+
+	if (stats) {
+		if (opts.stats_output == "-") {
+			std::cout << stats->to_json() << "\n";
+		} else {
+			std::ofstream fout(opts.stats_output.c_str());
+			fout << stats->to_json() << "\n";
+		}
+	}
 
-vec3f lerp_verts(const vec3i &va, const vec3i &vb, const float fa, const float fb, const float isoval) {
-	float t = 0;
-	if (std::abs(fa - fb) < 0.0001) {
-		t = 0.0;
-	} else {
-		t = (isoval - fa) / (fb - fa);
+	if (!opts.output.empty()) {
+		auto start = high_resolution_clock::now();
+		try {
+			for (size_t s = 0; s < meshes.size(); ++s) {
+				std::stringstream comment;
+				comment << "Isosurface of " << opts.fname << " at isovalue " << isovalues[s] * 255.f;
+				write_mesh(batch_output_path(opts.output, s), opts.mesh_format, meshes[s], {}, comment.str());
+			}
+		} catch (const std::runtime_error &e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+		auto end = high_resolution_clock::now();
+		std::cout << meshes.size() << " meshes written to " << batch_output_path(opts.output, 0)
+			<< "... in " << duration_cast<milliseconds>(end - start).count() << "ms\n";
 	}
-	return vec3f{va[0] + t * (vb[0] - va[0]),
-		va[1] + t * (vb[1] - va[1]),
-		va[2] + t * (vb[2] - va[2])};
+	return 0;
 }
 
-// Serial marching cubes.
-// Run the Marching Cubes algorithm on the volume to compute
-// the isosurface at the desired value. The volume is assumed
-// Dims should give the [x, y, z] dimensions of the volume
-void marching_cubes(const std::vector<uint8_t> &volume, const vec3sz &dims,
-		const float isovalue, std::vector<vec3f> &vertices)
-{	
-	size_t total_active = 0;
-	std::array<float, 8> vertex_values;
-	for (size_t k = 0; k < dims[2] - 1; ++k) {
-		for (size_t j = 0; j < dims[1] - 1; ++j) {
-			for (size_t i = 0; i < dims[0] - 1; ++i) {
-				compute_vertex_values(volume, dims, {i, j, k}, vertex_values);
-				size_t index = 0;
-				for (size_t v = 0; v < 8; ++v) {
-					if (vertex_values[v] <= isovalue) {
-						index |= 1 << v;
-					}
-				}
-
-				/* The cube vertex and edge indices for base rotation:
-				 *
-				 *      v7------e6------v6
-				 *     / |              /|
-				 *   e11 |            e10|
-				 *   /   e7           /  |
-				 *  /    |           /   e5
-				 *  v3------e2-------v2  |
-				 *  |    |           |   |
-				 *  |   v4------e4---|---v5
-				 *  e3  /           e1   /
-				 *  |  e8            |  e9
-				 *  | /              | /    y z
-				 *  |/               |/     |/
-				 *  v0------e0-------v1     O--x
-				 */
-
-				bool made_vert = false;
-				// The triangle table gives us the mapping from index to actual
-				// triangles to return for this configuration
-				for (size_t t = 0; tri_table[index][t] != -1; ++t) {
-					const int v0 = edge_vertices[tri_table[index][t]][0];
-					const int v1 = edge_vertices[tri_table[index][t]][1];
-
-					vec3f v = lerp_verts(index_to_vertex[v0], index_to_vertex[v1],
-						vertex_values[v0], vertex_values[v1], isovalue);
-
-					vertices.push_back({v[0] + i + 0.5f, v[1] + j + 0.5f, v[2] + k + 0.5f});
-					made_vert = true;
-				}
-				if (made_vert) {
-					++total_active;
+// Extract the volume slab by slab from the file, writing out each slab's triangles while
+// the next slabs are read and extracted
+template<typename T>
+int run_pipelined_extraction(const Options &opts) {
+	std::unique_ptr<MeshStreamWriter> writer;
+	size_t num_verts = 0;
+	auto start = high_resolution_clock::now();
+	try {
+		if (!opts.output.empty()) {
+			std::stringstream comment;
+			comment << "Isosurface of " << opts.fname << " at isovalue " << opts.isovalue * 255.f;
+			writer = std::make_unique<MeshStreamWriter>(opts.output, opts.mesh_format, comment.str());
+		}
+		pipelined_marching_cubes<T>(opts.fname, opts.dims, opts.isovalue, opts.pipeline_budget_mb << 20,
+			pipeline_slabs,
+			[&](const std::vector<vec3f> &slab_vertices) {
+				num_verts += slab_vertices.size();
+				if (writer) {
+					writer->append(slab_vertices);
 				}
-			}
+			},
+			opts.scan_backend);
+		if (writer) {
+			writer->close();
 		}
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << "\n";
+		return 1;
 	}
+	auto end = high_resolution_clock::now();
+	std::cout << "Isosurface with " << num_verts / 3 << " triangles computed"
+		<< (writer ? " and written to " + opts.output : "") << " in "
+		<< duration_cast<milliseconds>(end - start).count() << "ms (pipelined)\n";
+	return 0;
 }
 
-inline vec3sz voxel_id_to_voxel(const size_t id, const vec3sz &dims) {
-	return vec3sz{id % (dims[0] - 1),
-		(id / (dims[0] - 1)) % (dims[1] - 1),
-		id / ((dims[0] - 1) * (dims[1] - 1))
-	};
+#ifndef _WIN32
+std::unique_ptr<ResidentVolume> make_resident_volume(const VolumeSpec &spec, const size_t workspace_cap) {
+	switch (spec.type) {
+	case VoxelType::UINT8: return std::make_unique<ResidentVolumeOf<uint8_t>>(spec.fname, spec.dims, workspace_cap);
+	case VoxelType::UINT16: return std::make_unique<ResidentVolumeOf<uint16_t>>(spec.fname, spec.dims, workspace_cap);
+	case VoxelType::INT16: return std::make_unique<ResidentVolumeOf<int16_t>>(spec.fname, spec.dims, workspace_cap);
+	case VoxelType::FLOAT32: return std::make_unique<ResidentVolumeOf<float>>(spec.fname, spec.dims, workspace_cap);
+	}
+	return nullptr;
 }
-
-bool voxel_is_active(const std::vector<uint8_t> &volume, const vec3sz &dims,
-		const float isovalue, const size_t voxel_id)
-{
-	const vec3sz voxel = voxel_id_to_voxel(voxel_id, dims);
-	std::array<float, 8> vertex_values;
-	compute_vertex_values(volume, dims, voxel, vertex_values);
-
-	size_t index = 0;
-	for (size_t v = 0; v < 8; ++v) {
-		if (vertex_values[v] <= isovalue) {
-			index |= 1 << v;
+#endif
+
+// Load the volumes and answer isovalue queries on them until stopped, see mc_server.h.
+// Stdout carries the responses when serving stdin, so all messages go to stderr.
+int run_server(const Options &opts, const VoxelType voxel_type) {
+#ifndef _WIN32
+	std::vector<VolumeSpec> specs = opts.serve_volumes;
+	if (!opts.fname.empty()) {
+		specs.insert(specs.begin(), VolumeSpec{opts.fname, opts.dims, voxel_type});
+	}
+	if (specs.empty()) {
+		std::cerr << "-serve needs at least one volume, given by -f or -volume\n";
+		return 1;
+	}
+	IsosurfaceServer server(opts.scan_backend);
+	try {
+		for (const auto &spec : specs) {
+			if (spec.dims[0] * spec.dims[1] * spec.dims[2] == 0) {
+				std::cerr << "Volume " << spec.fname << " needs non-zero dims\n";
+				return 1;
+			}
+			server.add_volume(make_resident_volume(spec, opts.workspace_cap_mb << 20));
 		}
+		if (opts.serve == "-") {
+			server.serve_stdio();
+		} else {
+			server.serve_socket(opts.serve);
+		}
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << "\n";
+		return 1;
 	}
-	return index != 0 && index != tri_table.size() - 1;
+	return 0;
+#else
+	(void)opts;
+	(void)voxel_type;
+	std::cerr << "-serve is only supported on POSIX systems\n";
+	return 1;
+#endif
 }
 
-void compute_num_verts(const std::vector<uint8_t> &volume, const vec3sz &dims,
-		const float isovalue, const size_t voxel_id, const size_t active_id,
-		std::vector<uint32_t> &num_verts)
-{	
-	const vec3sz voxel = voxel_id_to_voxel(voxel_id, dims);
-
-	std::array<float, 8> vertex_values;
-	compute_vertex_values(volume, dims, voxel, vertex_values);
-
-	size_t index = 0;
-	for (size_t v = 0; v < 8; ++v) {
-		if (vertex_values[v] <= isovalue) {
-			index |= 1 << v;
-		}
+// Load the volume as voxels of type T and run the extraction selected by the options.
+// CellId is the type of the span space index's cell IDs, widened to 64 bits for volumes
+// with more than 2^32 cells.
+template<typename T, typename CellId = uint32_t>
+int run_extraction(const Options &opts) {
+	if (opts.pipeline_budget_mb != 0) {
+		return run_pipelined_extraction<T>(opts);
 	}
-
-	uint32_t nverts = 0;
-	// The triangle table gives us the mapping from index to actual
-	// triangles to return for this configuration
-	for (size_t t = 0; tri_table[index][t] != -1; ++t) {
-		++nverts;
+	if ((opts.span_space || opts.incremental) && !SpanSpaceIndex<T, CellId>::fits_cell_ids(opts.dims)) {
+		return run_extraction<T, uint64_t>(opts);
 	}
-	num_verts[active_id] = nverts;
-}
-
-void generate_vertices(const std::vector<uint8_t> &volume, const vec3sz &dims,
-		const float isovalue, const size_t voxel_id, const size_t active_id,
-		const std::vector<uint32_t> &offsets, std::vector<vec3f> &vertices)
-{	
-	const vec3sz voxel = voxel_id_to_voxel(voxel_id, dims);
-	const uint32_t vertex_offset = offsets[active_id];
-
-	std::array<float, 8> vertex_values;
-	compute_vertex_values(volume, dims, voxel, vertex_values);
-	size_t index = 0;
-	for (size_t v = 0; v < 8; ++v) {
-		if (vertex_values[v] <= isovalue) {
-			index |= 1 << v;
+	const std::string &fname = opts.fname;
+	const std::string &output = opts.output;
+	const vec3sz &dims = opts.dims;
+	const size_t benchmark_iters = opts.benchmark_iters;
+	const vec2f &bench_range = opts.bench_range;
+	const bool serial = opts.serial;
+	const ScanBackend scan_backend = opts.scan_backend;
+	const bool flying_edges = opts.flying_edges;
+	// Flying edges always outputs an indexed mesh
+	const bool indexed = opts.indexed || flying_edges;
+	const bool streaming = opts.stream_budget_mb != 0;
+	const bool incremental = opts.incremental;
+	const bool bricked = opts.brick_size != 0;
+	const size_t n_voxels = dims[0] * dims[1] * dims[2];
+	float isovalue = opts.isovalue;
+
+	// When streaming the volume is read slab by slab during the extraction instead
+	VolumeSource<T> volume;
+	if (!streaming) {
+		auto load_start = high_resolution_clock::now();
+		try {
+			volume = VolumeSource<T>(fname, n_voxels, VolumeAccess::SEQUENTIAL);
+		} catch (const std::runtime_error &e) {
+			std::cerr << e.what() << "\n";
+			return 1;
 		}
+		auto load_end = high_resolution_clock::now();
+		std::cout << "Volume " << (volume.is_mapped() ? "mapped" : "loaded") << " in "
+			<< duration_cast<milliseconds>(load_end - load_start).count() << "ms\n";
 	}
 
-	// The triangle table gives us the mapping from index to actual
-	// triangles to return for this configuration
-	for (size_t t = 0; tri_table[index][t] != -1; ++t) {
-		const int v0 = edge_vertices[tri_table[index][t]][0];
-		const int v1 = edge_vertices[tri_table[index][t]][1];
-
-		vec3f v = lerp_verts(index_to_vertex[v0], index_to_vertex[v1],
-				vertex_values[v0], vertex_values[v1], isovalue);
-		vertices[vertex_offset + t] = {
-			v[0] + voxel[0] + 0.5f, v[1] + voxel[1] + 0.5f, v[2] + voxel[2] + 0.5f
-		};
+	std::unique_ptr<MacrocellGrid<T>> grid;
+	if (opts.macrocell_size != 0) {
+		auto start = high_resolution_clock::now();
+		grid = std::make_unique<MacrocellGrid<T>>(volume, dims, opts.macrocell_size);
+		auto end = high_resolution_clock::now();
+		std::cout << "Macrocell grid of " << grid->dims[0] << "x" << grid->dims[1] << "x" << grid->dims[2]
+			<< " bricks (" << grid->bytes() << "b) built in "
+			<< duration_cast<milliseconds>(end - start).count() << "ms\n";
 	}
-}
-
-void data_parallel_marching_cubes(const std::vector<uint8_t> &volume, const vec3sz &dims,
-		const float isovalue, std::vector<vec3f> &vertices)
-{
-	// Determine which voxels will generate vertices. The last layer of voxels don't output verts
-	const size_t voxels_to_process = (dims[0] - 1) * (dims[1] - 1) * (dims[2] - 1);
-	std::vector<uint32_t> voxel_active(voxels_to_process, 0);
-	tbb::parallel_for(size_t(0), voxels_to_process,
-		[&](const size_t v) {
-			if (voxel_is_active(volume, dims, isovalue, v)) {
-				voxel_active[v] = 1;
-			}
-		});
-
-	// Exclusive scan to compute total number of active voxels and the offsets to write their ID
-	// to in the compaction
-	std::vector<uint32_t> offsets;
-	const uint32_t total_active = exclusive_scan(voxel_active, uint32_t(0), offsets, std::plus<uint32_t>{});
-
-	// Compact the active voxel IDs
-	std::vector<size_t> active_voxels(total_active, 0);
-	tbb::parallel_for(size_t(0), voxels_to_process,
-		[&](const size_t v) {
-			if (voxel_active[v]) {
-				active_voxels[offsets[v]] = v;
-			}
-		});
-
-	// Free voxel_active memory
-	voxel_active = std::vector<uint32_t>();
-
-	// Determine the number of vertices generated by each active voxel
-	std::vector<uint32_t> num_verts(total_active, 0);
-	tbb::parallel_for(size_t(0), num_verts.size(),
-		[&](const size_t v) {
-			compute_num_verts(volume, dims, isovalue, active_voxels[v], v, num_verts);
-		});
-
-	// Next we perform an exclusive scan to compute the offsets to write the output
-	// vertices to for each voxel, and the total number of vertices we'll generate
-	offsets.clear();
-	const uint32_t total_verts = exclusive_scan(num_verts, uint32_t(0), offsets, std::plus<uint32_t>{});
-
-	// Now we can compute the vertices for each voxel in parallel and write to the corresponding offsets
-	vertices.resize(total_verts);
-	tbb::parallel_for(size_t(0), num_verts.size(),
-		[&](const size_t v) {
-			generate_vertices(volume, dims, isovalue, active_voxels[v], v, offsets, vertices);
-		});
-
-}
 
-int main(int argc, char **argv) {
-	std::vector<std::string> args(argv, argv + argc);
-	std::string fname;
-	std::string output;
-	vec3sz dims = {0};
-	float isovalue = 0;
-    int benchmark_iters = 1;
-    vec2f bench_range = {0};
-	bool serial = false;
-	for (int i = 1; i < argc; ++i) {
-		if (args[i] == "-f") {
-			fname = argv[++i];
-		} else if (args[i] == "-dims") {
-			dims[0] = std::atoi(argv[++i]);
-			dims[1] = std::atoi(argv[++i]);
-			dims[2] = std::atoi(argv[++i]);
-		} else if (args[i] == "-iso") {
-			isovalue = std::atof(argv[++i]);
-        } else if (args[i] == "-bench") {
-            bench_range[0] = std::atof(argv[++i]);
-            bench_range[1] = std::atof(argv[++i]);
-            benchmark_iters = 100;
-		} else if (args[i] == "-o") {
-			output = args[++i];
-		} else if (args[i] == "-serial") {
-			serial = true;
+	std::unique_ptr<BrickedVolume<T>> bricked_volume;
+	if (bricked) {
+		auto start = high_resolution_clock::now();
+		try {
+			bricked_volume = std::make_unique<BrickedVolume<T>>(volume, dims, opts.brick_size);
+		} catch (const std::runtime_error &e) {
+			std::cerr << e.what() << "\n";
+			return 1;
 		}
+		auto end = high_resolution_clock::now();
+		std::cout << "Bricked volume of " << bricked_volume->brick_dims[0] << "x" << bricked_volume->brick_dims[1]
+			<< "x" << bricked_volume->brick_dims[2] << " bricks (" << bricked_volume->bytes() << "b) built in "
+			<< duration_cast<milliseconds>(end - start).count() << "ms\n";
 	}
 
-	const size_t n_voxels = dims[0] * dims[1] * dims[2];
-	if (fname.empty() || n_voxels == 0) {
-		std::cout << "Usage: " << args[0] << " -f <file.raw> -dims <x> <y> <z> -iso <v>\n"
-			<< "\tThe volume file must contain uint8_t row major data\n";
+	std::unique_ptr<SpanSpaceIndex<T, CellId>> span_index;
+	// The incremental extraction finds the cells which change with the index
+	if (opts.span_space || incremental) {
+		auto start = high_resolution_clock::now();
+		span_index = std::make_unique<SpanSpaceIndex<T, CellId>>(volume, dims);
+		auto end = high_resolution_clock::now();
+		std::cout << "Span space index of " << span_index->cells.size() << " cells ("
+			<< span_index->bytes() << "b) built in "
+			<< duration_cast<milliseconds>(end - start).count() << "ms\n";
+	}
+	// Brick skipping and span space queries only touch parts of the volume after the
+	// full passes building the grid or index
+	if (grid || span_index) {
+		volume.advise(VolumeAccess::RANDOM);
 	}
 
-	std::ifstream fin(fname.c_str(), std::ios::binary);
-	std::vector<uint8_t> volume(n_voxels, 0);
-	fin.read(reinterpret_cast<char*>(volume.data()), volume.size());
+	if (!opts.batch_isovalues.empty()) {
+		return run_batch_extraction(opts, volume, grid.get());
+	}
 
     size_t total_time = 0;
     float value_range = bench_range[1] - bench_range[0];
-    std::random_device rd;
-    std::mt19937 rng(rd());
+    // Fixed seed so benchmark runs pick the same isovalues and can be compared
+    std::mt19937 rng(opts.bench_seed);
     std::uniform_real_distribution<float> distrib;
 	std::vector<vec3f> vertices;
+	std::vector<uint32_t> indices;
+	// Stats of the last extraction, if requested
+	std::unique_ptr<ExtractionStats> stats;
+	// The pipeline's buffers are kept across the benchmark iterations
+	MarchingCubesContext<T, tbb::scalable_allocator> context(opts.workspace_cap_mb << 20);
+	FlyingEdgesWorkspace flying_edges_workspace;
+	std::vector<size_t> active_ids;
+	std::unique_ptr<IncrementalMarchingCubes<T, CellId>> incremental_mc;
+	if (incremental) {
+		incremental_mc = std::make_unique<IncrementalMarchingCubes<T, CellId>>(volume, dims, *span_index);
+	}
     for (size_t i = 0; i < benchmark_iters; ++i) {
         vertices.clear();
-        if (benchmark_iters != 1) {
+        indices.clear();
+        if (!opts.stats_output.empty()) {
+            stats = std::make_unique<ExtractionStats>();
+        }
+        if (incremental) {
+            isovalue = opts.isovalue + opts.incremental_step * i;
+            std::cout << "isovalue: " << isovalue << "\n";
+        } else if (benchmark_iters != 1) {
             isovalue = bench_range[0] + value_range * distrib(rng);
             std::cout << "isovalue: " << isovalue << "\n";
         }
 
         auto start = high_resolution_clock::now();
 
-        if (serial) {
-            marching_cubes(volume, dims, isovalue, vertices);
-        } else {
-            data_parallel_marching_cubes(volume, dims, isovalue, vertices);
+        // Reading a streamed volume fails if the file is too small, and the indexed
+        // paths fail if the mesh has more vertices than the indices can address
+        try {
+            if (serial) {
+                marching_cubes(volume, dims, isovalue, vertices, grid.get());
+            } else if (incremental) {
+                if (indexed) {
+                    incremental_mc->extract_indexed(isovalue, vertices, indices, scan_backend, stats.get());
+                } else {
+                    incremental_mc->extract(isovalue, vertices, scan_backend, stats.get());
+                }
+            } else if (span_index) {
+                StageTimer query_timer(stats.get(), "span_space_query");
+                span_index->query(isovalue, active_ids);
+                query_timer.stop(active_ids.size() * sizeof(size_t));
+
+                StageTimer classify_timer(stats.get(), "classify");
+                auto &active_voxels = context.active_voxels;
+                classify_voxels(volume, dims, isovalue, active_ids, active_voxels);
+                classify_timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+                STATS_RECORD(stats, active_voxels = active_voxels.size());
+                if (indexed) {
+                    extract_indexed_mesh(dims, isovalue, active_voxels, vertices, indices,
+                            context.indexed_workspace, scan_backend, stats.get());
+                } else {
+                    extract_active_voxels(dims, isovalue, active_voxels, vertices, context.num_verts,
+                            scan_backend, {0, 0, 0}, stats.get());
+                }
+                context.enforce_memory_cap();
+            } else if (streaming) {
+                streaming_marching_cubes<T>(fname, dims, isovalue, opts.stream_budget_mb << 20,
+                    [&](const std::vector<vec3f> &slab_vertices) {
+                        vertices.insert(vertices.end(), slab_vertices.begin(), slab_vertices.end());
+                    },
+                    scan_backend);
+            } else if (bricked) {
+                bricked_marching_cubes(*bricked_volume, isovalue, vertices, scan_backend, stats.get());
+            } else if (flying_edges) {
+                flying_edges_marching_cubes(volume, dims, isovalue, vertices, indices, flying_edges_workspace,
+                        scan_backend, stats.get());
+            } else if (indexed) {
+                context.extract_indexed(volume, dims, isovalue, vertices, indices, scan_backend, grid.get(),
+                        stats.get());
+            } else {
+                context.extract(volume, dims, isovalue, vertices, scan_backend, grid.get(), stats.get());
+            }
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
         }
 
         auto end = high_resolution_clock::now();
         auto dur = duration_cast<milliseconds>(end - start).count();
         total_time += dur;
 
-        std::cout << "Isosurface with " << vertices.size() / 3 << " triangles computed in "
-            << dur << "ms " << (serial ? "(serial)\n" : "(parallel)\n");
+        const size_t num_tris = indexed ? indices.size() / 3 : vertices.size() / 3;
+        std::cout << "Isosurface with " << num_tris << " triangles computed in "
+            << dur << "ms " << (serial ? "(serial)\n" : incremental ? "(incremental)\n" : span_index ? "(span space)\n"
+                : streaming ? "(streaming)\n" : bricked ? "(bricked)\n" : flying_edges ? "(flying edges)\n" : "(parallel)\n");
     }
     std::cout << "Average compute time: " << static_cast<float>(total_time) / benchmark_iters << "ms\n"; 
 
-	if (!output.empty()) {
-		std::ofstream fout(output.c_str());
-		fout << "# Isosurface of " << fname << " at isovalue " << isovalue * 255.f << "\n";
-		for (const auto &v : vertices) {
-			fout << "v " << v[0] << " " << v[1] << " " << v[2] << "\n";
+	if (incremental) {
+		std::cout << "Incremental extraction holds " << incremental_mc->bytes() << "b\n";
+	} else if (flying_edges) {
+		std::cout << "Flying edges workspace holds " << flying_edges_workspace.bytes() << "b\n";
+	} else if (!serial && !streaming && !bricked) {
+		std::cout << "Extraction workspaces hold " << context.bytes() << "b\n";
+	}
+
+	if (stats) {
+		if (opts.stats_output == "-") {
+			std::cout << stats->to_json() << "\n";
+		} else {
+			std::ofstream fout(opts.stats_output.c_str());
+			fout << stats->to_json() << "\n";
 		}
+	}
 
-		// Every three pairs of vertices forms a face
-		for (size_t i = 0; i < vertices.size(); i += 3) {
-			fout << "f " << i + 1 << " " << i + 2 << " " << i + 3 << "\n";
+	if (!output.empty()) {
+		auto start = high_resolution_clock::now();
+		std::stringstream comment;
+		comment << "Isosurface of " << fname << " at isovalue " << isovalue * 255.f;
+		try {
+			write_mesh(output, opts.mesh_format, vertices, indices, comment.str());
+		} catch (const std::runtime_error &e) {
+			std::cerr << e.what() << "\n";
+			return 1;
 		}
+		auto end = high_resolution_clock::now();
+		std::cout << "Mesh written to " << output << " in "
+			<< duration_cast<milliseconds>(end - start).count() << "ms\n";
 	}
 
 	return 0;
 }
 
+int main(int argc, char **argv) {
+	std::vector<std::string> args(argv, argv + argc);
+	Options opts;
+	std::string format;
+	VoxelType voxel_type = VoxelType::UINT8;
+	for (int i = 1; i < argc; ++i) {
+		if (args[i] == "-f") {
+			opts.fname = argv[++i];
+		} else if (args[i] == "-dims") {
+			opts.dims[0] = std::atoi(argv[++i]);
+			opts.dims[1] = std::atoi(argv[++i]);
+			opts.dims[2] = std::atoi(argv[++i]);
+		} else if (args[i] == "-iso") {
+			opts.isovalue = std::atof(argv[++i]);
+		} else if (args[i] == "-isos") {
+			while (i + 1 < argc && (args[i + 1][0] != '-' || std::isdigit(args[i + 1][1]))) {
+				opts.batch_isovalues.push_back(std::atof(argv[++i]));
+			}
+        } else if (args[i] == "-bench") {
+            opts.bench_range[0] = std::atof(argv[++i]);
+            opts.bench_range[1] = std::atof(argv[++i]);
+            opts.benchmark_iters = 100;
+		} else if (args[i] == "-workspace-cap") {
+			opts.workspace_cap_mb = std::atoi(argv[++i]);
+		} else if (args[i] == "-stats") {
+			opts.stats_output = args[++i];
+		} else if (args[i] == "-seed") {
+			opts.bench_seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (args[i] == "-o") {
+			opts.output = args[++i];
+		} else if (args[i] == "-serial") {
+			opts.serial = true;
+		} else if (args[i] == "-flying-edges") {
+			opts.flying_edges = true;
+		} else if (args[i] == "-format") {
+			format = args[++i];
+		} else if (args[i] == "-stream") {
+			opts.stream_budget_mb = std::atoi(argv[++i]);
+		} else if (args[i] == "-serve") {
+			opts.serve = args[++i];
+		} else if (args[i] == "-volume") {
+			VolumeSpec spec;
+			spec.fname = args[++i];
+			spec.dims[0] = std::atoi(argv[++i]);
+			spec.dims[1] = std::atoi(argv[++i]);
+			spec.dims[2] = std::atoi(argv[++i]);
+			const std::string type = args[++i];
+			if (!parse_voxel_type(type, spec.type)) {
+				std::cerr << "Unknown voxel type '" << type << "', expected uint8, uint16, int16 or float32\n";
+				return 1;
+			}
+			opts.serve_volumes.push_back(spec);
+		} else if (args[i] == "-pipeline") {
+			opts.pipeline_budget_mb = std::atoi(argv[++i]);
+		} else if (args[i] == "-indexed") {
+			opts.indexed = true;
+		} else if (args[i] == "-span-space") {
+			opts.span_space = true;
+		} else if (args[i] == "-incremental") {
+			opts.incremental = true;
+			opts.incremental_step = std::atof(argv[++i]);
+			opts.benchmark_iters = std::max(1, std::atoi(argv[++i]));
+		} else if (args[i] == "-bricks") {
+			opts.brick_size = std::atoi(argv[++i]);
+		} else if (args[i] == "-macrocell") {
+			opts.macrocell_size = std::atoi(argv[++i]);
+		} else if (args[i] == "-type") {
+			const std::string type = args[++i];
+			if (!parse_voxel_type(type, voxel_type)) {
+				std::cerr << "Unknown voxel type '" << type << "', expected uint8, uint16, int16 or float32\n";
+				return 1;
+			}
+		} else if (args[i] == "-scan") {
+			const std::string backend = args[++i];
+			if (backend == "tbb") {
+				opts.scan_backend = ScanBackend::TBB;
+			} else if (backend == "lookback") {
+				opts.scan_backend = ScanBackend::DECOUPLED_LOOKBACK;
+			} else {
+				std::cerr << "Unknown scan backend '" << backend << "', expected tbb or lookback\n";
+				return 1;
+			}
+		}
+	}
+
+	opts.mesh_format = mesh_format_from_path(opts.output);
+	if (!format.empty() && !parse_mesh_format(format, opts.mesh_format)) {
+		std::cerr << "Unknown mesh format '" << format << "', expected obj, ply or raw\n";
+		return 1;
+	}
+	if (opts.indexed && opts.serial) {
+		std::cerr << "-indexed is only supported by the parallel extraction\n";
+		return 1;
+	}
+	if (opts.flying_edges
+			&& (opts.serial || opts.span_space || opts.stream_budget_mb != 0 || opts.macrocell_size != 0))
+	{
+		std::cerr << "-flying-edges can't be combined with -serial, -span-space, -stream or -macrocell\n";
+		return 1;
+	}
+	if (!opts.batch_isovalues.empty()
+			&& (opts.serial || opts.indexed || opts.flying_edges || opts.span_space || opts.stream_budget_mb != 0
+				|| opts.benchmark_iters != 1))
+	{
+		std::cerr << "-isos can't be combined with -serial, -indexed, -flying-edges, -span-space, -stream or -bench\n";
+		return 1;
+	}
+	if (opts.incremental
+			&& (opts.serial || opts.flying_edges || opts.stream_budget_mb != 0 || opts.macrocell_size != 0
+				|| !opts.batch_isovalues.empty() || opts.bench_range[0] != opts.bench_range[1]))
+	{
+		std::cerr << "-incremental can't be combined with -serial, -flying-edges, -stream, -macrocell, -isos or -bench\n";
+		return 1;
+	}
+	if (opts.brick_size != 0
+			&& (opts.serial || opts.indexed || opts.flying_edges || opts.span_space || opts.incremental
+				|| opts.stream_budget_mb != 0 || opts.macrocell_size != 0 || !opts.batch_isovalues.empty()))
+	{
+		std::cerr << "-bricks can't be combined with -serial, -indexed, -flying-edges, -span-space, -incremental,"
+			<< " -stream, -macrocell or -isos\n";
+		return 1;
+	}
+	if (opts.pipeline_budget_mb != 0
+			&& (opts.serial || opts.indexed || opts.flying_edges || opts.span_space || opts.incremental
+				|| opts.stream_budget_mb != 0 || opts.macrocell_size != 0 || opts.brick_size != 0
+				|| !opts.batch_isovalues.empty() || opts.benchmark_iters != 1))
+	{
+		std::cerr << "-pipeline can't be combined with -serial, -indexed, -flying-edges, -span-space, -incremental,"
+			<< " -stream, -macrocell, -bricks, -isos or -bench\n";
+		return 1;
+	}
+	if (opts.stream_budget_mb != 0
+			&& (opts.serial || opts.indexed || opts.span_space || opts.macrocell_size != 0))
+	{
+		std::cerr << "-stream can't be combined with -serial, -indexed, -span-space or -macrocell\n";
+		return 1;
+	}
+
+	if (!opts.serve.empty()) {
+		if (opts.serial || opts.indexed || opts.flying_edges || opts.span_space || opts.incremental
+				|| opts.stream_budget_mb != 0 || opts.pipeline_budget_mb != 0 || opts.macrocell_size != 0
+				|| opts.brick_size != 0 || !opts.batch_isovalues.empty() || opts.benchmark_iters != 1
+				|| !opts.output.empty())
+		{
+			std::cerr << "-serve only takes the volumes, -scan and -workspace-cap, the queries pick the"
+				<< " isovalue and mesh type\n";
+			return 1;
+		}
+		return run_server(opts, voxel_type);
+	}
+	if (!opts.serve_volumes.empty()) {
+		std::cerr << "-volume is only used by -serve\n";
+		return 1;
+	}
+
+	if (opts.fname.empty() || opts.dims[0] * opts.dims[1] * opts.dims[2] == 0) {
+		std::cout << "Usage: " << args[0] << " -f <file.raw> -dims <x> <y> <z> -iso <v>\n"
+			<< "\tThe volume file must contain row major voxels in the host's byte order\n"
+			<< "\t-type <uint8|uint16|int16|float32> sets the voxel type, uint8 by default\n"
+			<< "\t-serial runs the serial extraction instead of the data parallel one\n"
+			<< "\t-flying-edges runs the Flying Edges extraction, which outputs an indexed mesh\n"
+			<< "\t-scan <tbb|lookback> selects the scan backend used by the parallel path\n"
+			<< "\t-isos <v...> extracts a batch of isovalues in one pass, writing a mesh per isovalue\n"
+			<< "\t\twith _i added to the output name\n"
+			<< "\t-macrocell <n> skips empty regions using a min/max grid of n^3 cell bricks\n"
+			<< "\t-bricks <n> converts the volume to bricks of n^3 cells (a power of two) and extracts\n"
+			<< "\t\tbrick by brick, skipping bricks which can't contain the surface\n"
+			<< "\t-span-space builds a span space index of the cells to answer each isovalue query\n"
+			<< "\t-incremental <step> <n> runs n extractions from the isovalue moving it by step each time,\n"
+			<< "\t\tlike dragging a slider, updating the previous surface using a span space index\n"
+			<< "\t-indexed outputs an indexed mesh with shared vertices instead of triangle soup\n"
+			<< "\t-stream <MB> extracts the volume in z-slabs read from the file, using at most MB\n"
+			<< "\t\tmegabytes of memory, or enough for two z-slices, on top of the output mesh, for\n"
+			<< "\t\tvolumes larger than RAM\n"
+			<< "\t-pipeline <MB> streams z-slabs as -stream does, overlapping reading the next slabs,\n"
+			<< "\t\textracting and writing out the previous ones to the output\n"
+			<< "\t-serve <socket|-> keeps the volume loaded and answers isovalue queries from clients on\n"
+			<< "\t\tthe Unix socket, or stdin with the meshes on stdout, see mc_server.h\n"
+			<< "\t-volume <file> <x> <y> <z> <type> adds another volume for -serve to load\n"
+			<< "\t-bench <lo> <hi> times 100 extractions at random isovalues in [lo, hi]\n"
+			<< "\t-seed <n> seeds the -bench isovalues, so runs with the same seed can be compared\n"
+			<< "\t-workspace-cap <MB> frees the buffers kept between extractions if they grow past MB\n"
+			<< "\t-stats <file|-> writes per-stage timings and counts of the last extraction as JSON\n"
+			<< "\t-o <file> writes the mesh, as OBJ, binary PLY or raw based on the extension\n"
+			<< "\t-format <obj|ply|raw> overrides the output format picked from the extension\n";
+	}
+
+	switch (voxel_type) {
+	case VoxelType::UINT8: return run_extraction<uint8_t>(opts);
+	case VoxelType::UINT16: return run_extraction<uint16_t>(opts);
+	case VoxelType::INT16: return run_extraction<int16_t>(opts);
+	case VoxelType::FLOAT32: return run_extraction<float>(opts);
+	}
+	return 1;
+}
@@ -0,0 +1,1307 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_pipeline.h>
+#include <tbb/parallel_sort.h>
+#include "scan.h"
+#include "classify_simd.h"
+#include "mc_tables.h"
+#include "mc_stats.h"
+#include "vec.h"
+#include "volume_source.h"
+
+// Compute the vertex values of the cell given the ID of its bottom vertex
+template<typename T, typename V>
+void compute_vertex_values(const VolumeSource<T> &volume, const vec3sz &dims, const vec3sz &cell,
+		std::array<V, 8> &values)
+{
+	for (size_t i = 0; i < index_to_vertex.size(); ++i) {
+		const auto &v = index_to_vertex[i];
+		// We want to swap the order we go when on the top of the cube,
+		// due to how the indices are labeled in the paper.
+		size_t voxel = ((cell[2] + v[2]) * dims[1] + cell[1] + v[1]) * dims[0] + cell[0] + v[0];
+		values[i] = volume[voxel];
+	};
+}
+
+// The isovalue as the volume classification compares voxels against it. Integer voxels are
+// compared to floor(isovalue) as integers, which gives the same result as comparing them to
+// the isovalue but avoids converting each voxel to float. Floating point voxels are compared
+// to the isovalue directly.
+template<typename T>
+using iso_threshold_t = typename std::conditional<std::is_integral<T>::value, int64_t, float>::type;
+
+template<typename T>
+iso_threshold_t<T> iso_threshold(const float isovalue) {
+	if constexpr (std::is_integral<T>::value) {
+		// Clamp to a range holding all values of T, so out of range isovalues keep all
+		// voxels on the same side of the threshold
+		const double lo = double(std::numeric_limits<T>::lowest()) - 1;
+		const double hi = double(std::numeric_limits<T>::max());
+		return int64_t(std::min(std::max(std::floor(double(isovalue)), lo), hi));
+	} else {
+		return isovalue;
+	}
+}
+
+// Compute the cube case index of the cell, which has bit v set if vertex v is <= the isovalue
+template<typename V, typename S>
+uint8_t compute_cube_case(const std::array<V, 8> &values, const S isovalue) {
+	uint8_t index = 0;
+	for (size_t v = 0; v < 8; ++v) {
+		if (values[v] <= isovalue) {
+			index |= 1 << v;
+		}
+	}
+	return index;
+}
+
+inline vec3f lerp_verts(const vec3i &va, const vec3i &vb, const float fa, const float fb, const float isoval) {
+	float t = 0;
+	if (std::abs(fa - fb) < 0.0001) {
+		t = 0.0;
+	} else {
+		t = (isoval - fa) / (fb - fa);
+	}
+	return vec3f{va[0] + t * (vb[0] - va[0]),
+		va[1] + t * (vb[1] - va[1]),
+		va[2] + t * (vb[2] - va[2])};
+}
+
+// Min/max values of each brick of cells in the volume. Bricks whose value range doesn't
+// contain the isovalue can't contain active voxels and are skipped without visiting
+// their voxels. The grid is built once per volume and reused for any isovalue.
+template<typename T>
+struct MacrocellGrid {
+	// Number of cells along each side of a brick
+	size_t brick_size = 8;
+	// Number of bricks along each axis
+	vec3sz dims = {0};
+	// The [min, max] voxel values of each brick, including the voxels on its far faces
+	// which are shared with the next brick
+	std::vector<std::array<T, 2>> ranges;
+
+	MacrocellGrid() = default;
+
+	MacrocellGrid(const VolumeSource<T> &volume, const vec3sz &volume_dims, const size_t brick_size = 8)
+		: brick_size(brick_size)
+	{
+		for (size_t i = 0; i < 3; ++i) {
+			dims[i] = (volume_dims[i] - 1 + brick_size - 1) / brick_size;
+		}
+		ranges.resize(dims[0] * dims[1] * dims[2]);
+		tbb::parallel_for(size_t(0), ranges.size(),
+			[&](const size_t b) {
+				const vec3sz brick = {b % dims[0], (b / dims[0]) % dims[1], b / (dims[0] * dims[1])};
+				vec3sz begin, end;
+				for (size_t i = 0; i < 3; ++i) {
+					begin[i] = brick[i] * brick_size;
+					end[i] = std::min(begin[i] + brick_size + 1, volume_dims[i]);
+				}
+				std::array<T, 2> range = {std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest()};
+				for (size_t k = begin[2]; k < end[2]; ++k) {
+					for (size_t j = begin[1]; j < end[1]; ++j) {
+						const size_t row = (k * volume_dims[1] + j) * volume_dims[0];
+						for (size_t i = begin[0]; i < end[0]; ++i) {
+							range[0] = std::min(range[0], volume[row + i]);
+							range[1] = std::max(range[1], volume[row + i]);
+						}
+					}
+				}
+				ranges[b] = range;
+			});
+	}
+
+	// Get the brick containing the cell
+	size_t brick_id(const vec3sz &cell) const {
+		return ((cell[2] / brick_size) * dims[1] + cell[1] / brick_size) * dims[0] + cell[0] / brick_size;
+	}
+
+	// A cell is active if some corner is <= the isovalue and another is above it,
+	// so the brick can only contain active cells if its range straddles the isovalue
+	bool brick_may_be_active(const size_t brick, const float isovalue) const {
+		return ranges[brick][0] <= isovalue && ranges[brick][1] > isovalue;
+	}
+
+	size_t bytes() const {
+		return ranges.size() * sizeof(std::array<T, 2>);
+	}
+};
+
+// Call f(begin, end) for each span of cells along the x-row (j, k) of the volume which
+// lies in a brick of the grid that may contain active cells. If there's no grid the
+// whole row is passed.
+template<typename T, typename F>
+void for_each_candidate_span(const MacrocellGrid<T> *grid, const vec3sz &dims, const size_t j,
+		const size_t k, const float isovalue, F f)
+{
+	const size_t row_cells = dims[0] - 1;
+	if (!grid) {
+		f(size_t(0), row_cells);
+		return;
+	}
+	const size_t row_brick = grid->brick_id({0, j, k});
+	for (size_t b = 0; b < grid->dims[0]; ++b) {
+		if (grid->brick_may_be_active(row_brick + b, isovalue)) {
+			f(b * grid->brick_size, std::min((b + 1) * grid->brick_size, row_cells));
+		}
+	}
+}
+
+// Serial marching cubes.
+// Run the Marching Cubes algorithm on the volume to compute
+// the isosurface at the desired value. The volume is assumed
+// Dims should give the [x, y, z] dimensions of the volume
+// If a macrocell grid is passed, bricks which can't contain the isosurface are skipped.
+template<typename T>
+void marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<vec3f> &vertices,
+		const MacrocellGrid<T> *grid = nullptr)
+{	
+	size_t total_active = 0;
+	std::array<float, 8> vertex_values;
+	for (size_t k = 0; k < dims[2] - 1; ++k) {
+		for (size_t j = 0; j < dims[1] - 1; ++j) {
+			for_each_candidate_span(grid, dims, j, k, isovalue,
+				[&](const size_t span_begin, const size_t span_end) {
+				for (size_t i = span_begin; i < span_end; ++i) {
+					compute_vertex_values(volume, dims, {i, j, k}, vertex_values);
+					const uint8_t index = compute_cube_case(vertex_values, isovalue);
+
+					/* The cube vertex and edge indices for base rotation:
+					 *
+					 *      v7------e6------v6
+					 *     / |              /|
+					 *   e11 |            e10|
+					 *   /   e7           /  |
+					 *  /    |           /   e5
+					 *  v3------e2-------v2  |
+					 *  |    |           |   |
+					 *  |   v4------e4---|---v5
+					 *  e3  /           e1   /
+					 *  |  e8            |  e9
+					 *  | /              | /    y z
+					 *  |/               |/     |/
+					 *  v0------e0-------v1     O--x
+					 */
+
+					bool made_vert = false;
+					// The triangle table gives us the mapping from index to actual
+					// triangles to return for this configuration
+					for (size_t t = case_edge_offsets[index]; t < case_edge_offsets[index + 1]; ++t) {
+						const int v0 = edge_vertices[case_edges[t]][0];
+						const int v1 = edge_vertices[case_edges[t]][1];
+
+						vec3f v = lerp_verts(index_to_vertex[v0], index_to_vertex[v1],
+							vertex_values[v0], vertex_values[v1], isovalue);
+
+						vertices.push_back({v[0] + i + 0.5f, v[1] + j + 0.5f, v[2] + k + 0.5f});
+						made_vert = true;
+					}
+					if (made_vert) {
+						++total_active;
+					}
+				}
+				});
+		}
+	}
+}
+
+inline vec3sz voxel_id_to_voxel(const size_t id, const vec3sz &dims) {
+	return vec3sz{id % (dims[0] - 1),
+		(id / (dims[0] - 1)) % (dims[1] - 1),
+		id / ((dims[0] - 1) * (dims[1] - 1))
+	};
+}
+
+// An active voxel found by the classification. Its cube case and corner values are
+// kept so the later stages don't need to gather them from the volume again.
+template<typename T>
+struct ActiveVoxel {
+	size_t id;
+	std::array<T, 8> values;
+	uint8_t cube_case;
+};
+
+// Classify the voxel against the isovalue threshold, returning true and filling out active
+// if it will generate vertices
+template<typename T>
+bool classify_voxel(const VolumeSource<T> &volume, const vec3sz &dims,
+		const iso_threshold_t<T> threshold, const vec3sz &voxel, const size_t voxel_id,
+		ActiveVoxel<T> &active)
+{
+	compute_vertex_values(volume, dims, voxel, active.values);
+	active.cube_case = compute_cube_case(active.values, threshold);
+	active.id = voxel_id;
+	return active.cube_case != 0 && active.cube_case != 255;
+}
+
+// Classify a list of voxel IDs known to be active, e.g., from a span space query
+template<typename T, typename A>
+void classify_voxels(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, const std::vector<size_t> &voxel_ids,
+		std::vector<ActiveVoxel<T>, A> &active_voxels)
+{
+	const iso_threshold_t<T> threshold = iso_threshold<T>(isovalue);
+	active_voxels.resize(voxel_ids.size());
+	tbb::parallel_for(size_t(0), voxel_ids.size(),
+		[&](const size_t v) {
+			classify_voxel(volume, dims, threshold, voxel_id_to_voxel(voxel_ids[v], dims),
+					voxel_ids[v], active_voxels[v]);
+		});
+}
+
+// Generate the vertices of the active voxel, given the position of its cell in the volume
+template<typename T>
+void generate_cell_vertices(const vec3sz &voxel, const float isovalue, const ActiveVoxel<T> &active,
+		const uint64_t vertex_offset, std::vector<vec3f> &vertices)
+{
+	const uint8_t index = active.cube_case;
+
+	// The triangle table gives us the mapping from index to actual
+	// triangles to return for this configuration
+	const size_t edges_begin = case_edge_offsets[index];
+	for (size_t t = 0; t < case_num_verts[index]; ++t) {
+		const int v0 = edge_vertices[case_edges[edges_begin + t]][0];
+		const int v1 = edge_vertices[case_edges[edges_begin + t]][1];
+
+		vec3f v = lerp_verts(index_to_vertex[v0], index_to_vertex[v1],
+				active.values[v0], active.values[v1], isovalue);
+		vertices[vertex_offset + t] = {
+			v[0] + voxel[0] + 0.5f, v[1] + voxel[1] + 0.5f, v[2] + voxel[2] + 0.5f
+		};
+	}
+}
+
+// Generate the vertices of the active voxel. The origin is added to the voxel's position,
+// for when the dims are those of a sub-volume, e.g. a slab of a larger volume.
+template<typename T>
+void generate_vertices(const vec3sz &dims, const float isovalue, const ActiveVoxel<T> &active,
+		const uint64_t vertex_offset, std::vector<vec3f> &vertices, const vec3sz &origin = {0, 0, 0})
+{
+	vec3sz voxel = voxel_id_to_voxel(active.id, dims);
+	for (size_t i = 0; i < 3; ++i) {
+		voxel[i] += origin[i];
+	}
+	generate_cell_vertices(voxel, isovalue, active, vertex_offset, vertices);
+}
+
+// Compute the vertices of the isosurface for the classified active voxels, using scans to
+// find the offsets each voxel writes its vertices to. The offsets are computed in num_verts,
+// which can be kept to reuse its memory in later calls. They're 32-bit, and switch to being
+// local to blocks of voxels with 64-bit block bases when the vertex count could overflow
+// them. If stats are passed the count, scan and generate stages are recorded in them.
+template<typename T, typename AV, typename AO>
+void extract_active_voxels(const vec3sz &dims, const float isovalue,
+		const std::vector<ActiveVoxel<T>, AV> &active_voxels, std::vector<vec3f> &vertices,
+		std::vector<uint32_t, AO> &num_verts, const ScanBackend scan_backend = ScanBackend::TBB,
+		const vec3sz &origin = {0, 0, 0}, ExtractionStats *stats = nullptr)
+{
+	// Determine the number of vertices generated by each active voxel from its cube case.
+	// Every count is written, so reused memory doesn't need to be cleared.
+	StageTimer count_timer(stats, "count_vertices");
+	num_verts.resize(active_voxels.size());
+	counted_parallel_for(num_verts.size(), stats,
+		[&](const size_t v) {
+			num_verts[v] = case_num_verts[active_voxels[v].cube_case];
+		});
+	count_timer.stop(num_verts.size() * sizeof(uint32_t));
+
+	// Next we perform an exclusive scan in place to compute the offsets to write the output
+	// vertices to for each voxel, and the total number of vertices we'll generate
+	StageTimer scan_timer(stats, "scan_vertices");
+	TwoLevelOffsets offsets;
+	const uint64_t total_verts = two_level_exclusive_scan(num_verts.data(), num_verts.size(),
+			max_case_verts, offsets, scan_backend);
+	scan_timer.stop();
+
+	// Now we can compute the vertices for each voxel in parallel and write to the corresponding offsets
+	StageTimer generate_timer(stats, "generate_vertices");
+	vertices.resize(total_verts);
+	counted_parallel_for(num_verts.size(), stats,
+		[&](const size_t v) {
+			generate_vertices(dims, isovalue, active_voxels[v], offsets(num_verts.data(), v), vertices, origin);
+		});
+	generate_timer.stop(vertices.size() * sizeof(vec3f));
+	STATS_RECORD(stats, vertices += vertices.size());
+	STATS_RECORD(stats, freed(num_verts.size() * sizeof(uint32_t)));
+}
+
+// Compute the vertices of the isosurface for the classified active voxels, see above
+template<typename T, typename AV>
+void extract_active_voxels(const vec3sz &dims, const float isovalue,
+		const std::vector<ActiveVoxel<T>, AV> &active_voxels, std::vector<vec3f> &vertices,
+		const ScanBackend scan_backend = ScanBackend::TBB, const vec3sz &origin = {0, 0, 0},
+		ExtractionStats *stats = nullptr)
+{
+	std::vector<uint32_t> num_verts;
+	extract_active_voxels(dims, isovalue, active_voxels, vertices, num_verts, scan_backend, origin, stats);
+}
+
+// Append the active cells among [begin, end) of an x-row of cells to out, given their cube
+// cases. The corners of the cells are on the voxel rows as in classify_simd.h, and the first
+// cell of the row has ID row_id.
+template<typename T, typename A>
+void append_active_cells(const T *const rows[4], const size_t row_id, const size_t begin,
+		const size_t end, const uint8_t *cases, std::vector<ActiveVoxel<T>, A> &out)
+{
+	ActiveVoxel<T> active;
+	for (size_t i = begin; i < end; ++i) {
+		// Skip 8 cells at a time while they're all inside or outside the surface. Flipping the
+		// bytes with their low bit set maps cases 0 and 255 to 0, and active cases to non-zero.
+		if (i + 8 <= end) {
+			uint64_t word;
+			std::memcpy(&word, cases + (i - begin), sizeof(word));
+			if ((word ^ ((word & 0x0101010101010101ull) * 0xff)) == 0) {
+				i += 7;
+				continue;
+			}
+		}
+		const uint8_t cube_case = cases[i - begin];
+		if (cube_case == 0 || cube_case == 255) {
+			continue;
+		}
+		for (size_t v = 0; v < 8; ++v) {
+			active.values[v] = rows[simd::row_corner_row[v]][i + simd::row_corner_dx[v]];
+		}
+		active.cube_case = cube_case;
+		active.id = row_id + i;
+		out.push_back(active);
+	}
+}
+
+// Find the active voxels of the volume and classify them, working on x-rows of cells so
+// we can skip inactive bricks if we have a macrocell grid. The cube cases of each span of
+// the row are computed at once by the row kernels in classify_simd.h, and only the active
+// cells gather their corner values. The voxels are output in order of increasing ID.
+// The compaction buffers are kept in the workspace to reuse their memory in later calls.
+template<typename T, typename AV, typename AW>
+void classify_active_voxels(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<ActiveVoxel<T>, AV> &active_voxels,
+		CompactWorkspace<ActiveVoxel<T>, AW> &workspace,
+		const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+{
+	StageTimer timer(stats, "classify");
+	const iso_threshold_t<T> threshold = iso_threshold<T>(isovalue);
+	// The last layer of voxels don't output verts
+	const size_t row_cells = dims[0] - 1;
+	const size_t num_rows = (dims[1] - 1) * (dims[2] - 1);
+	tbb::enumerable_thread_specific<std::vector<uint8_t>> case_buffers;
+	compact_tiles(num_rows, active_voxels,
+		[&](const size_t row, std::vector<ActiveVoxel<T>, AW> &row_active) {
+			STATS_RECORD(stats, count_task());
+			const size_t j = row % (dims[1] - 1);
+			const size_t k = row / (dims[1] - 1);
+			const T *rows[4];
+			for (size_t r = 0; r < 4; ++r) {
+				rows[r] = volume.data() + ((k + r / 2) * dims[1] + j + r % 2) * dims[0];
+			}
+			std::vector<uint8_t> &cases = case_buffers.local();
+			cases.resize(row_cells);
+			for_each_candidate_span(grid, dims, j, k, isovalue,
+				[&](const size_t begin, const size_t end) {
+					simd::row_cube_cases(rows, begin, end, threshold, cases.data());
+					append_active_cells(rows, row * row_cells, begin, end, cases.data(), row_active);
+				});
+		},
+		workspace);
+	timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+	STATS_RECORD(stats, active_voxels += active_voxels.size());
+}
+
+// Find and classify the active voxels of the volume using temporary buffers, see above
+template<typename T, typename AV>
+void classify_active_voxels(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<ActiveVoxel<T>, AV> &active_voxels,
+		const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+{
+	CompactWorkspace<ActiveVoxel<T>> workspace;
+	classify_active_voxels(volume, dims, isovalue, active_voxels, workspace, grid, stats);
+}
+
+template<typename T>
+void data_parallel_marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<vec3f> &vertices,
+		const ScanBackend scan_backend = ScanBackend::TBB,
+		const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+{
+	// Determine which voxels will generate vertices and compact them
+	std::vector<ActiveVoxel<T>> active_voxels;
+	classify_active_voxels(volume, dims, isovalue, active_voxels, grid, stats);
+
+	extract_active_voxels(dims, isovalue, active_voxels, vertices, scan_backend, {0, 0, 0}, stats);
+	STATS_RECORD(stats, freed(active_voxels.size() * sizeof(ActiveVoxel<T>)));
+}
+
+// Find the active voxels of the volume for each of a batch of isovalues in a single pass.
+// Each span of an x-row of cells is classified against all the isovalues whose surfaces
+// may cross it at once, so the corners of each block of cells are loaded once for the whole
+// batch. Without a macrocell grid the span is the whole row, with one each brick along the
+// row is a span. The active voxels of isovalue s start at active_voxels[iso_starts[s]], and
+// are in order of increasing ID.
+template<typename T>
+void classify_active_voxels_batch(const VolumeSource<T> &volume, const vec3sz &dims,
+		const std::vector<float> &isovalues, std::vector<ActiveVoxel<T>> &active_voxels,
+		std::vector<size_t> &iso_starts, const MacrocellGrid<T> *grid = nullptr,
+		ExtractionStats *stats = nullptr)
+{
+	StageTimer timer(stats, "classify");
+	const size_t row_cells = dims[0] - 1;
+	const size_t num_rows = (dims[1] - 1) * (dims[2] - 1);
+	const size_t span_cells = grid ? grid->brick_size : row_cells;
+	// The isovalues classified in a span, their thresholds and case buffers
+	struct SpanBatch {
+		std::vector<size_t> isos;
+		std::vector<iso_threshold_t<T>> thresholds;
+		std::vector<uint8_t*> cases;
+		std::vector<uint8_t> case_buffer;
+	};
+	tbb::enumerable_thread_specific<SpanBatch> span_batches;
+	compact_tiles_segmented(num_rows, isovalues.size(), active_voxels, iso_starts,
+		[&](const size_t row, std::vector<std::vector<ActiveVoxel<T>>> &iso_active) {
+			STATS_RECORD(stats, count_task());
+			const size_t j = row % (dims[1] - 1);
+			const size_t k = row / (dims[1] - 1);
+			const T *rows[4];
+			for (size_t r = 0; r < 4; ++r) {
+				rows[r] = volume.data() + ((k + r / 2) * dims[1] + j + r % 2) * dims[0];
+			}
+			SpanBatch &batch = span_batches.local();
+			batch.case_buffer.resize(isovalues.size() * span_cells);
+			const size_t row_brick = grid ? grid->brick_id({0, j, k}) : 0;
+			for (size_t begin = 0; begin < row_cells; begin += span_cells) {
+				const size_t end = std::min(begin + span_cells, row_cells);
+				batch.isos.clear();
+				batch.thresholds.clear();
+				batch.cases.clear();
+				for (size_t s = 0; s < isovalues.size(); ++s) {
+					if (grid && !grid->brick_may_be_active(row_brick + begin / span_cells, isovalues[s])) {
+						continue;
+					}
+					batch.isos.push_back(s);
+					batch.thresholds.push_back(iso_threshold<T>(isovalues[s]));
+					batch.cases.push_back(batch.case_buffer.data() + batch.cases.size() * span_cells);
+				}
+				simd::row_cube_cases(rows, begin, end, batch.thresholds.data(), batch.thresholds.size(),
+						batch.cases.data());
+				for (size_t b = 0; b < batch.isos.size(); ++b) {
+					append_active_cells(rows, row * row_cells, begin, end, batch.cases[b],
+							iso_active[batch.isos[b]]);
+				}
+			}
+		});
+	timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+	STATS_RECORD(stats, active_voxels += active_voxels.size());
+}
+
+namespace detail {
+
+// Count, scan and generate the vertices of a batch of isovalues with counts of type C
+template<typename C, typename T>
+void extract_active_voxels_batch(const vec3sz &dims, const std::vector<float> &isovalues,
+		const std::vector<ActiveVoxel<T>> &active_voxels, const std::vector<size_t> &iso_starts,
+		std::vector<std::vector<vec3f>> &meshes, const ScanBackend scan_backend, ExtractionStats *stats)
+{
+	StageTimer count_timer(stats, "count_vertices");
+	std::vector<C> offsets(active_voxels.size());
+	counted_parallel_for(offsets.size(), stats,
+		[&](const size_t v) {
+			offsets[v] = case_num_verts[active_voxels[v].cube_case];
+		});
+	count_timer.stop(offsets.size() * sizeof(C));
+
+	// A single segmented scan gives the offsets of each voxel within its isovalue's mesh,
+	// and the number of vertices of each mesh
+	StageTimer scan_timer(stats, "scan_vertices");
+	std::vector<C> iso_verts;
+	segmented_exclusive_scan_offsets(offsets, iso_starts, C(0), offsets, iso_verts, std::plus<C>{},
+			scan_backend);
+	scan_timer.stop();
+
+	StageTimer generate_timer(stats, "generate_vertices");
+	size_t total_verts = 0;
+	for (size_t s = 0; s < isovalues.size(); ++s) {
+		meshes[s].resize(iso_verts[s]);
+		total_verts += iso_verts[s];
+	}
+	for (size_t s = 0; s < isovalues.size(); ++s) {
+		const size_t begin = iso_starts[s];
+		const size_t end = s + 1 < isovalues.size() ? iso_starts[s + 1] : active_voxels.size();
+		counted_parallel_for(end - begin, stats,
+			[&](const size_t i) {
+				generate_vertices(dims, isovalues[s], active_voxels[begin + i], offsets[begin + i], meshes[s]);
+			});
+	}
+	generate_timer.stop(total_verts * sizeof(vec3f));
+	STATS_RECORD(stats, vertices += total_verts);
+	STATS_RECORD(stats, freed(offsets.size() * sizeof(C)));
+}
+
+}
+
+// Compute the isosurfaces of a batch of isovalues, e.g., nested surfaces for layered
+// rendering, writing the vertices of isovalue s to meshes[s]. The active voxels of every
+// isovalue are found in one pass over the volume, and the vertex counts of the whole batch
+// are scanned at once by a segmented scan with a segment per isovalue, so each stage runs
+// once for the batch instead of once per isovalue.
+template<typename T>
+void batch_marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const std::vector<float> &isovalues, std::vector<std::vector<vec3f>> &meshes,
+		const ScanBackend scan_backend = ScanBackend::TBB,
+		const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+{
+	std::vector<ActiveVoxel<T>> active_voxels;
+	std::vector<size_t> iso_starts;
+	classify_active_voxels_batch(volume, dims, isovalues, active_voxels, iso_starts, grid, stats);
+
+	meshes.resize(isovalues.size());
+	// The counts are scanned as 32-bit unless the batch's vertices could overflow them
+	if (active_voxels.size() <= std::numeric_limits<uint32_t>::max() / max_case_verts) {
+		detail::extract_active_voxels_batch<uint32_t>(dims, isovalues, active_voxels, iso_starts, meshes,
+				scan_backend, stats);
+	} else {
+		detail::extract_active_voxels_batch<uint64_t>(dims, isovalues, active_voxels, iso_starts, meshes,
+				scan_backend, stats);
+	}
+	STATS_RECORD(stats, freed(active_voxels.size() * sizeof(ActiveVoxel<T>)));
+}
+
+// Bytes a slab of the streaming extraction needs per voxel in the worst case, where every
+// cell is active: the voxel, the cell's active voxel in both the compaction's per-thread
+// buffers and its output, and its vertex count. The vertices aren't included, as they're
+// the slab's output and their number depends on the surface instead of the slab size.
+template<typename T>
+size_t slab_bytes_per_voxel() {
+	return sizeof(T) + 2 * sizeof(ActiveVoxel<T>) + sizeof(uint32_t);
+}
+
+// Number of z-slices of voxels read per slab by streaming_marching_cubes, so that the slab's
+// worst case working set fits in the memory budget, see slab_bytes_per_voxel. At least two
+// slices are read, giving one layer of cells, so a budget smaller than two slices' worth
+// is exceeded.
+template<typename T>
+size_t slab_slices_for_budget(const vec3sz &dims, const size_t memory_budget) {
+	const size_t slice_bytes = dims[0] * dims[1] * slab_bytes_per_voxel<T>();
+	return std::max(memory_budget / slice_bytes, size_t(2));
+}
+
+// Out-of-core marching cubes for volumes too large to load. The raw file is read in slabs
+// of z-slices, each overlapping the previous by one slice so the cells between them are
+// covered, and each slab is extracted with the data parallel pipeline. After each slab,
+// on_slab(slab_vertices) is called with its part of the surface, in the same order and
+// with the same values as data_parallel_marching_cubes would produce them for the whole
+// volume. Only one slab is held at a time, sized so its voxels, active voxels and vertex
+// counts fit in the budget even if every cell is active. The slab's vertices and what on_slab
+// keeps come on top of the budget.
+template<typename T, typename F>
+void streaming_marching_cubes(const std::string &fname, const vec3sz &dims,
+		const float isovalue, const size_t memory_budget, F on_slab,
+		const ScanBackend scan_backend = ScanBackend::TBB)
+{
+	std::ifstream fin(fname.c_str(), std::ios::binary);
+	if (!fin) {
+		throw std::runtime_error("Failed to open " + fname);
+	}
+	const size_t slice_voxels = dims[0] * dims[1];
+	const size_t slab_slices = slab_slices_for_budget<T>(dims, memory_budget);
+
+	// The pipeline's buffers are reused by each slab
+	std::vector<ActiveVoxel<T>> active_voxels;
+	CompactWorkspace<ActiveVoxel<T>> compact_workspace;
+	std::vector<uint32_t> num_verts;
+	std::vector<vec3f> slab_vertices;
+	// The slab [k_begin, k_end) of cell layers reads the voxel slices [k_begin, k_end]
+	for (size_t k_begin = 0; k_begin + 1 < dims[2]; k_begin += slab_slices - 1) {
+		const size_t k_end = std::min(k_begin + slab_slices - 1, dims[2] - 1);
+		const vec3sz slab_dims = {dims[0], dims[1], k_end - k_begin + 1};
+
+		std::vector<T> slab_data(slice_voxels * slab_dims[2]);
+		fin.seekg(k_begin * slice_voxels * sizeof(T));
+		if (!fin.read(reinterpret_cast<char*>(slab_data.data()), slab_data.size() * sizeof(T))) {
+			throw std::runtime_error("Volume file " + fname + " is smaller than the volume dimensions");
+		}
+		const VolumeSource<T> slab(std::move(slab_data));
+
+		slab_vertices.clear();
+		classify_active_voxels(slab, slab_dims, isovalue, active_voxels, compact_workspace);
+		extract_active_voxels(slab_dims, isovalue, active_voxels, slab_vertices, num_verts, scan_backend,
+				vec3sz{0, 0, k_begin});
+		on_slab(slab_vertices);
+	}
+}
+
+// Out-of-core marching cubes which overlaps reading the volume, extracting the surface and
+// consuming it, so the time taken approaches the longer of the IO and the compute rather
+// than their sum. The file is split into overlapping slabs as in streaming_marching_cubes,
+// which pass through a TBB pipeline: the slabs are read in order, extracted in parallel, and
+// on_slab(slab_vertices) is called in order with each slab's part of the surface, e.g. to
+// write it out, while the next slabs are read and extracted. At most max_slabs slabs are
+// in flight, each with its own buffers, and the slabs are sized so the worst case working
+// sets of all of them fit in the memory budget as in streaming_marching_cubes, aside from
+// their vertices and what on_slab keeps.
+template<typename T, typename F>
+void pipelined_marching_cubes(const std::string &fname, const vec3sz &dims,
+		const float isovalue, const size_t memory_budget, const size_t max_slabs, F on_slab,
+		const ScanBackend scan_backend = ScanBackend::TBB)
+{
+	std::ifstream fin(fname.c_str(), std::ios::binary);
+	if (!fin) {
+		throw std::runtime_error("Failed to open " + fname);
+	}
+	const size_t slice_voxels = dims[0] * dims[1];
+	const size_t slab_slices = slab_slices_for_budget<T>(dims, memory_budget / max_slabs);
+
+	struct Slab {
+		size_t k_begin = 0;
+		vec3sz dims = {0};
+		VolumeSource<T> volume;
+		std::vector<ActiveVoxel<T>> active_voxels;
+		CompactWorkspace<ActiveVoxel<T>> compact_workspace;
+		std::vector<uint32_t> num_verts;
+		std::vector<vec3f> vertices;
+	};
+	// Slab i uses buffers i % max_slabs. The slabs finish in order, and the pipeline only
+	// starts a slab once fewer than max_slabs are in flight, so slab i - max_slabs is done
+	// with the buffers when slab i starts.
+	std::vector<Slab> slabs(max_slabs);
+	size_t next_slab = 0;
+	size_t k_begin = 0;
+	tbb::parallel_pipeline(max_slabs,
+		tbb::make_filter<void, Slab*>(tbb::filter_mode::serial_in_order,
+			[&](tbb::flow_control &fc) -> Slab* {
+				// The slab [k_begin, k_end) of cell layers reads the voxel slices [k_begin, k_end]
+				if (k_begin + 1 >= dims[2]) {
+					fc.stop();
+					return nullptr;
+				}
+				Slab &slab = slabs[next_slab++ % max_slabs];
+				const size_t k_end = std::min(k_begin + slab_slices - 1, dims[2] - 1);
+				slab.k_begin = k_begin;
+				slab.dims = {dims[0], dims[1], k_end - k_begin + 1};
+				std::vector<T> slab_data(slice_voxels * slab.dims[2]);
+				fin.seekg(k_begin * slice_voxels * sizeof(T));
+				if (!fin.read(reinterpret_cast<char*>(slab_data.data()), slab_data.size() * sizeof(T))) {
+					throw std::runtime_error("Volume file " + fname + " is smaller than the volume dimensions");
+				}
+				slab.volume = VolumeSource<T>(std::move(slab_data));
+				k_begin = k_end;
+				return &slab;
+			})
+		& tbb::make_filter<Slab*, Slab*>(tbb::filter_mode::parallel,
+			[&](Slab *slab) -> Slab* {
+				slab->vertices.clear();
+				classify_active_voxels(slab->volume, slab->dims, isovalue, slab->active_voxels, slab->compact_workspace);
+				extract_active_voxels(slab->dims, isovalue, slab->active_voxels, slab->vertices, slab->num_verts,
+						scan_backend, vec3sz{0, 0, slab->k_begin});
+				// The voxels aren't needed while the slab waits to be consumed
+				slab->volume = VolumeSource<T>();
+				return slab;
+			})
+		& tbb::make_filter<Slab*, void>(tbb::filter_mode::serial_in_order,
+			[&](Slab *slab) {
+				on_slab(slab->vertices);
+			}));
+}
+
+inline uint32_t popcount(uint32_t x) {
+	x = x - ((x >> 1) & 0x55555555);
+	x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+	return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// Returns the mask of the cell's edges which it owns in the indexed mesh. Each edge of the
+// grid is owned by the cell containing it with the largest coordinates on the axes the edge
+// doesn't run along. Interior cells own the 3 edges starting at their bottom vertex, and
+// cells on the far faces of the volume also own the edges on those faces.
+inline uint16_t owned_edges(const vec3sz &dims, const vec3sz &cell) {
+	uint16_t mask = 0;
+	for (size_t e = 0; e < edge_axis.size(); ++e) {
+		const vec3i &origin = index_to_vertex[edge_origin[e]];
+		bool owned = true;
+		for (size_t a = 0; a < 3; ++a) {
+			if (a != edge_axis[e] && origin[a] == 1 && cell[a] != dims[a] - 2) {
+				owned = false;
+			}
+		}
+		if (owned) {
+			mask |= 1 << e;
+		}
+	}
+	return mask;
+}
+
+// Per active voxel buffers used by extract_indexed_mesh, which can be kept to reuse their
+// memory in later calls. A is the allocator of the uint32_t buffers, rebound for the others.
+template<typename A = std::allocator<uint32_t>>
+struct IndexedMeshWorkspace {
+	using EdgeAllocator = typename std::allocator_traits<A>::template rebind_alloc<uint16_t>;
+
+	// The edges owned by each voxel which have a vertex
+	std::vector<uint16_t, EdgeAllocator> vertex_edges;
+	std::vector<uint32_t, A> vertex_offsets;
+	std::vector<uint32_t, A> index_offsets;
+
+	size_t bytes() const {
+		return vertex_edges.capacity() * sizeof(uint16_t)
+			+ (vertex_offsets.capacity() + index_offsets.capacity()) * sizeof(uint32_t);
+	}
+
+	void release() {
+		vertex_edges = decltype(vertex_edges)();
+		vertex_offsets = decltype(vertex_offsets)();
+		index_offsets = decltype(index_offsets)();
+	}
+};
+
+// Compute an indexed mesh of the isosurface for the classified active voxels, which must be
+// in order of increasing ID. Each vertex lies on a unique edge of the grid and is shared by
+// all the triangles which touch that edge. The vertices are generated by a count/scan/generate
+// pass over the edges owned by each active voxel, and the triangles by a second one which
+// finds the vertex of each triangle edge through the active voxel owning it, found from
+// cursors following the voxel through the neighbouring rows of active voxels. The per-voxel
+// offsets are 32-bit two level offsets, see two_level_exclusive_scan, and the indices are
+// of type I. Throws std::overflow_error if there are more vertices than I can index.
+template<typename T, typename I, typename AV, typename AW>
+void extract_indexed_mesh(const vec3sz &dims, const float isovalue,
+		const std::vector<ActiveVoxel<T>, AV> &active_voxels, std::vector<vec3f> &vertices,
+		std::vector<I> &indices, IndexedMeshWorkspace<AW> &workspace,
+		const ScanBackend scan_backend = ScanBackend::TBB, ExtractionStats *stats = nullptr)
+{
+	StageTimer count_vertices_timer(stats, "count_vertices");
+	// Every edge crossed by the surface is owned by an active voxel, since the voxel
+	// contains the edge's two vertices on opposite sides of the isovalue. Each entry of the
+	// workspace buffers is written, so reused memory doesn't need to be cleared.
+	auto &vertex_edges = workspace.vertex_edges;
+	auto &vertex_offsets = workspace.vertex_offsets;
+	vertex_edges.resize(active_voxels.size());
+	vertex_offsets.resize(active_voxels.size());
+	counted_parallel_for(active_voxels.size(), stats,
+		[&](const size_t v) {
+			const vec3sz voxel = voxel_id_to_voxel(active_voxels[v].id, dims);
+			vertex_edges[v] = owned_edges(dims, voxel) & case_crossed_edges[active_voxels[v].cube_case];
+			vertex_offsets[v] = popcount(vertex_edges[v]);
+		});
+	count_vertices_timer.stop(active_voxels.size() * (sizeof(uint16_t) + sizeof(uint32_t)));
+
+	StageTimer scan_vertices_timer(stats, "scan_vertices");
+	TwoLevelOffsets vertex_bases;
+	const uint64_t total_verts = two_level_exclusive_scan(vertex_offsets.data(), vertex_offsets.size(),
+			uint32_t(edge_axis.size()), vertex_bases, scan_backend);
+	scan_vertices_timer.stop();
+	if (total_verts > std::numeric_limits<I>::max()) {
+		throw std::overflow_error("The indexed mesh has " + std::to_string(total_verts)
+				+ " vertices, which is more than its index type can address");
+	}
+
+	StageTimer generate_vertices_timer(stats, "generate_vertices");
+	vertices.resize(total_verts);
+	counted_parallel_for(active_voxels.size(), stats,
+		[&](const size_t v) {
+			const ActiveVoxel<T> &active = active_voxels[v];
+			const vec3sz voxel = voxel_id_to_voxel(active.id, dims);
+			uint64_t out = vertex_bases(vertex_offsets.data(), v);
+			for (size_t e = 0; e < edge_axis.size(); ++e) {
+				if (!(vertex_edges[v] & (1 << e))) {
+					continue;
+				}
+				// Always interpolate from the edge's origin so the result doesn't depend
+				// on which cell the edge is seen from
+				const int v0 = edge_origin[e];
+				const int v1 = edge_vertices[e][0] == v0 ? edge_vertices[e][1] : edge_vertices[e][0];
+				vec3f p = lerp_verts(index_to_vertex[v0], index_to_vertex[v1],
+						active.values[v0], active.values[v1], isovalue);
+				vertices[out++] = {
+					p[0] + voxel[0] + 0.5f, p[1] + voxel[1] + 0.5f, p[2] + voxel[2] + 0.5f
+				};
+			}
+		});
+	generate_vertices_timer.stop(vertices.size() * sizeof(vec3f));
+
+	// Each triangle vertex of an active voxel writes one index
+	StageTimer count_indices_timer(stats, "count_indices");
+	auto &index_offsets = workspace.index_offsets;
+	index_offsets.resize(active_voxels.size());
+	counted_parallel_for(active_voxels.size(), stats,
+		[&](const size_t v) {
+			index_offsets[v] = case_num_verts[active_voxels[v].cube_case];
+		});
+	count_indices_timer.stop(index_offsets.size() * sizeof(uint32_t));
+
+	StageTimer scan_indices_timer(stats, "scan_indices");
+	TwoLevelOffsets index_bases;
+	const uint64_t total_indices = two_level_exclusive_scan(index_offsets.data(), index_offsets.size(),
+			max_case_verts, index_bases, scan_backend);
+	scan_indices_timer.stop();
+
+	StageTimer generate_indices_timer(stats, "generate_indices");
+	indices.resize(total_indices);
+	const size_t row_cells = dims[0] - 1;
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, active_voxels.size()),
+		[&](const tbb::blocked_range<size_t> &r) {
+			STATS_RECORD(stats, count_task());
+			// The owner of an edge is the voxel itself or one of the next voxels along each axis,
+			// so it lies at the same or next x in one of the 4 rows at the same or next y and z.
+			// The voxels are visited in order of ID, so a cursor into each of those rows is kept
+			// at the first active voxel at or after the current x, moving it forward with a
+			// galloping search which usually stops after a step or two.
+			const auto advance = [&](size_t &cursor, const size_t id) {
+				size_t step = 1;
+				while (cursor + step < active_voxels.size() && active_voxels[cursor + step].id < id) {
+					cursor += step;
+					step *= 2;
+				}
+				cursor = std::lower_bound(active_voxels.begin() + cursor,
+						active_voxels.begin() + std::min(cursor + step, active_voxels.size()), id,
+						[](const ActiveVoxel<T> &a, const size_t id) {
+							return a.id < id;
+						}) - active_voxels.begin();
+			};
+			size_t cursors[4] = {r.begin(), r.begin(), r.begin(), r.begin()};
+			for (size_t v = r.begin(); v != r.end(); ++v) {
+				const ActiveVoxel<T> &active = active_voxels[v];
+				const vec3sz voxel = voxel_id_to_voxel(active.id, dims);
+				for (size_t n = 0; n < 4; ++n) {
+					const size_t y = std::min(voxel[1] + (n & 1), dims[1] - 2);
+					const size_t z = std::min(voxel[2] + (n >> 1), dims[2] - 2);
+					advance(cursors[n], (z * (dims[1] - 1) + y) * row_cells + voxel[0]);
+				}
+
+				const uint8_t index = active.cube_case;
+				const size_t edges_begin = case_edge_offsets[index];
+				const uint64_t out = index_bases(index_offsets.data(), v);
+				for (size_t t = 0; t < case_num_verts[index]; ++t) {
+					const uint8_t e = case_edges[edges_begin + t];
+					const uint8_t axis = edge_axis[e];
+					const vec3i &origin = index_to_vertex[edge_origin[e]];
+
+					// Find the voxel owning the edge, and the edge's index within it
+					vec3sz owner;
+					vec3i owner_offset = {0, 0, 0};
+					for (size_t a = 0; a < 3; ++a) {
+						owner[a] = voxel[a] + origin[a];
+						if (a != axis && owner[a] > dims[a] - 2) {
+							owner[a] = dims[a] - 2;
+						}
+						owner_offset[a] = int(voxel[a] + origin[a] - owner[a]);
+					}
+					// The owner is active as it contains the crossed edge, so it's either the
+					// cursor of its row or the voxel after it
+					const size_t owner_id = (owner[2] * (dims[1] - 1) + owner[1]) * row_cells + owner[0];
+					size_t owner_index = cursors[(owner[1] - voxel[1]) | ((owner[2] - voxel[2]) << 1)];
+					if (active_voxels[owner_index].id != owner_id) {
+						++owner_index;
+					}
+					const uint8_t owner_edge = offset_axis_edge[detail::vertex_offset_index(owner_offset)][axis];
+					indices[out + t] = I(vertex_bases(vertex_offsets.data(), owner_index)
+						+ popcount(vertex_edges[owner_index] & ((1u << owner_edge) - 1)));
+				}
+			}
+		});
+	generate_indices_timer.stop(indices.size() * sizeof(I));
+	STATS_RECORD(stats, vertices += vertices.size());
+	STATS_RECORD(stats, indices += indices.size());
+	STATS_RECORD(stats, freed(active_voxels.size() * (sizeof(uint16_t) + 2 * sizeof(uint32_t))));
+}
+
+// Compute an indexed mesh of the isosurface using temporary buffers, see above
+template<typename T, typename I, typename AV>
+void extract_indexed_mesh(const vec3sz &dims, const float isovalue,
+		const std::vector<ActiveVoxel<T>, AV> &active_voxels, std::vector<vec3f> &vertices,
+		std::vector<I> &indices, const ScanBackend scan_backend = ScanBackend::TBB,
+		ExtractionStats *stats = nullptr)
+{
+	IndexedMeshWorkspace<> workspace;
+	extract_indexed_mesh(dims, isovalue, active_voxels, vertices, indices, workspace, scan_backend, stats);
+}
+
+// Compute an indexed mesh of the isosurface where triangles share the vertices on their
+// common edges, see extract_indexed_mesh
+template<typename T, typename I>
+void indexed_marching_cubes(const VolumeSource<T> &volume, const vec3sz &dims,
+		const float isovalue, std::vector<vec3f> &vertices, std::vector<I> &indices,
+		const ScanBackend scan_backend = ScanBackend::TBB,
+		const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+{
+	std::vector<ActiveVoxel<T>> active_voxels;
+	classify_active_voxels(volume, dims, isovalue, active_voxels, grid, stats);
+
+	extract_indexed_mesh(dims, isovalue, active_voxels, vertices, indices, scan_backend, stats);
+	STATS_RECORD(stats, freed(active_voxels.size() * sizeof(ActiveVoxel<T>)));
+}
+
+// Persistent workspaces for repeated extractions, e.g., over a sweep of isovalues or in a
+// long running service. The per-voxel buffers of the pipeline are kept between calls and
+// only grow when an extraction needs more than the previous ones did, so once warmed up
+// extractions don't allocate or fault in fresh pages. Allocator is the allocator template
+// used for the buffers, e.g. tbb::scalable_allocator to take them from TBB's scalable pools.
+template<typename T, template<typename> class Allocator = std::allocator>
+struct MarchingCubesContext {
+	std::vector<ActiveVoxel<T>, Allocator<ActiveVoxel<T>>> active_voxels;
+	CompactWorkspace<ActiveVoxel<T>, Allocator<ActiveVoxel<T>>> compact_workspace;
+	std::vector<uint32_t, Allocator<uint32_t>> num_verts;
+	IndexedMeshWorkspace<Allocator<uint32_t>> indexed_workspace;
+	// If non-zero, the workspaces are released after any extraction which leaves them
+	// holding more than this many bytes
+	size_t memory_cap = 0;
+
+	MarchingCubesContext() = default;
+
+	explicit MarchingCubesContext(const size_t memory_cap) : memory_cap(memory_cap) {}
+
+	// Compute the isosurface as triangle soup, see data_parallel_marching_cubes
+	void extract(const VolumeSource<T> &volume, const vec3sz &dims, const float isovalue,
+			std::vector<vec3f> &vertices, const ScanBackend scan_backend = ScanBackend::TBB,
+			const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+	{
+		classify_active_voxels(volume, dims, isovalue, active_voxels, compact_workspace, grid, stats);
+		extract_active_voxels(dims, isovalue, active_voxels, vertices, num_verts, scan_backend,
+				{0, 0, 0}, stats);
+		enforce_memory_cap();
+	}
+
+	// Compute the isosurface as an indexed mesh, see indexed_marching_cubes
+	template<typename I>
+	void extract_indexed(const VolumeSource<T> &volume, const vec3sz &dims, const float isovalue,
+			std::vector<vec3f> &vertices, std::vector<I> &indices,
+			const ScanBackend scan_backend = ScanBackend::TBB,
+			const MacrocellGrid<T> *grid = nullptr, ExtractionStats *stats = nullptr)
+	{
+		classify_active_voxels(volume, dims, isovalue, active_voxels, compact_workspace, grid, stats);
+		extract_indexed_mesh(dims, isovalue, active_voxels, vertices, indices, indexed_workspace,
+				scan_backend, stats);
+		enforce_memory_cap();
+	}
+
+	// Bytes currently held by the workspaces
+	size_t bytes() const {
+		return active_voxels.capacity() * sizeof(ActiveVoxel<T>) + compact_workspace.bytes()
+			+ num_verts.capacity() * sizeof(uint32_t) + indexed_workspace.bytes();
+	}
+
+	// Free the memory held by the workspaces
+	void release() {
+		active_voxels = decltype(active_voxels)();
+		compact_workspace.release();
+		num_verts = decltype(num_verts)();
+		indexed_workspace.release();
+	}
+
+	// Release the workspaces if they hold more than the memory cap
+	void enforce_memory_cap() {
+		if (memory_cap != 0 && bytes() > memory_cap) {
+			release();
+		}
+	}
+};
+
+// Span space index over the cells of the volume for repeated isovalue queries, see
+// Livnat, Shen and Johnson, "A Near Optimal Isosurface Extraction Algorithm Using the
+// Span Space", 1996. Each cell is a point (min, max) in span space and is active for an
+// isovalue if min <= isovalue < max. Cells are sorted by min and split into chunks, and
+// the cells within each chunk are sorted by max in descending order. A query finds the
+// chunks whose cells all have min <= isovalue with a binary search and takes the prefix
+// of each with max > isovalue, so the cost of a query scales with the number of active
+// cells instead of the size of the volume. Cells whose min == max can never be active
+// and aren't stored. Cell IDs are stored as I, 32-bit by default to keep the index small,
+// so volumes with more than 2^32 cells need a 64-bit I, see fits_cell_ids.
+template<typename T, typename I = uint32_t>
+struct SpanSpaceIndex {
+	// Number of cells in each chunk
+	static const size_t chunk_size = 1024;
+
+	// The cell IDs, and their min and max values, by chunk
+	std::vector<I> cells;
+	std::vector<T> cell_min;
+	std::vector<T> cell_max;
+	// The largest min value of the cells in each chunk
+	std::vector<T> chunk_max_min;
+
+	SpanSpaceIndex() = default;
+
+	// Throws if the volume's cell IDs don't fit in I
+	SpanSpaceIndex(const VolumeSource<T> &volume, const vec3sz &dims) {
+		struct CellSpan {
+			I cell;
+			T min;
+			T max;
+		};
+		if (!fits_cell_ids(dims)) {
+			throw std::runtime_error("SpanSpaceIndex: volume has too many cells for "
+					+ std::to_string(sizeof(I) * 8) + "-bit cell IDs");
+		}
+		const size_t row_cells = dims[0] - 1;
+		const size_t num_rows = (dims[1] - 1) * (dims[2] - 1);
+
+		std::vector<CellSpan> spans;
+		compact_tiles(num_rows, spans,
+			[&](const size_t row, std::vector<CellSpan> &row_spans) {
+				const size_t j = row % (dims[1] - 1);
+				const size_t k = row / (dims[1] - 1);
+				std::array<T, 8> vertex_values;
+				for (size_t i = 0; i < row_cells; ++i) {
+					compute_vertex_values(volume, dims, {i, j, k}, vertex_values);
+					const auto range = std::minmax_element(vertex_values.begin(), vertex_values.end());
+					if (*range.first != *range.second) {
+						row_spans.push_back(CellSpan{I(row * row_cells + i),
+								*range.first, *range.second});
+					}
+				}
+			});
+
+		tbb::parallel_sort(spans.begin(), spans.end(),
+			[](const CellSpan &a, const CellSpan &b) {
+				return a.min < b.min;
+			});
+
+		const size_t num_chunks = (spans.size() + chunk_size - 1) / chunk_size;
+		cells.resize(spans.size());
+		cell_min.resize(spans.size());
+		cell_max.resize(spans.size());
+		chunk_max_min.resize(num_chunks);
+		tbb::parallel_for(size_t(0), num_chunks,
+			[&](const size_t c) {
+				const auto begin = spans.begin() + c * chunk_size;
+				const auto end = spans.begin() + std::min(spans.size(), (c + 1) * chunk_size);
+				chunk_max_min[c] = (end - 1)->min;
+				std::sort(begin, end,
+					[](const CellSpan &a, const CellSpan &b) {
+						return a.max > b.max;
+					});
+				for (auto it = begin; it != end; ++it) {
+					const size_t i = it - spans.begin();
+					cells[i] = it->cell;
+					cell_min[i] = it->min;
+					cell_max[i] = it->max;
+				}
+			});
+	}
+
+	// Whether the IDs of all the cells of a volume of the dims fit in I
+	static bool fits_cell_ids(const vec3sz &dims) {
+		const uint64_t num_cells = uint64_t(dims[0] - 1) * (dims[1] - 1) * (dims[2] - 1);
+		return num_cells <= std::numeric_limits<I>::max();
+	}
+
+	// Find the IDs of the cells which are active at the isovalue, in increasing order
+	void query(const float isovalue, std::vector<size_t> &active_cells) const {
+		// Chunks are sorted by min, so all chunks up to and including the first one with
+		// a cell with min > isovalue may contain active cells
+		const size_t num_chunks = std::upper_bound(chunk_max_min.begin(), chunk_max_min.end(), isovalue,
+				[](const float v, const T m) {
+					return v < m;
+				}) - chunk_max_min.begin();
+		const size_t last_chunk = std::min(num_chunks + 1, chunk_max_min.size());
+
+		compact_tiles(last_chunk, active_cells,
+			[&](const size_t c, std::vector<size_t> &chunk_active) {
+				const size_t begin = c * chunk_size;
+				const size_t end = std::min(cells.size(), begin + chunk_size);
+				if (c < num_chunks) {
+					// All cells in the chunk have min <= isovalue, and are sorted by max
+					const size_t count = std::partition_point(cell_max.begin() + begin, cell_max.begin() + end,
+							[&](const T m) {
+								return m > isovalue;
+							}) - (cell_max.begin() + begin);
+					chunk_active.insert(chunk_active.end(), cells.begin() + begin, cells.begin() + begin + count);
+				} else {
+					for (size_t i = begin; i < end && cell_max[i] > isovalue; ++i) {
+						if (cell_min[i] <= isovalue) {
+							chunk_active.push_back(cells[i]);
+						}
+					}
+				}
+			});
+		tbb::parallel_sort(active_cells.begin(), active_cells.end());
+	}
+
+	// Find the IDs of the cells which are inactive at isovalue from but active at isovalue
+	// to, in increasing order. Such a cell's min is in (from, to] if the isovalue increased,
+	// and its max is in (to, from] if it decreased, so only the chunks holding the mins in
+	// the range, or the part of each chunk with its max in the range, are visited.
+	void query_changed(const float from, const float to, std::vector<size_t> &changed_cells) const {
+		const auto chunks_up_to = [&](const float isovalue) -> size_t {
+			return std::upper_bound(chunk_max_min.begin(), chunk_max_min.end(), isovalue,
+					[](const float v, const T m) {
+						return v < m;
+					}) - chunk_max_min.begin();
+		};
+		changed_cells.clear();
+		if (to > from) {
+			// The mins in (from, to] start in the first chunk with a min > from and end in
+			// the first chunk with a min > to. Cells are sorted by max within each chunk,
+			// so only the prefix with max > to is checked.
+			const size_t first_chunk = chunks_up_to(from);
+			const size_t last_chunk = std::min(chunks_up_to(to) + 1, chunk_max_min.size());
+			compact_tiles(last_chunk - first_chunk, changed_cells,
+				[&](const size_t t, std::vector<size_t> &chunk_changed) {
+					const size_t begin = (first_chunk + t) * chunk_size;
+					const size_t end = std::min(cells.size(), begin + chunk_size);
+					for (size_t i = begin; i < end && cell_max[i] > to; ++i) {
+						if (cell_min[i] > from && cell_min[i] <= to) {
+							chunk_changed.push_back(cells[i]);
+						}
+					}
+				});
+		} else if (to < from) {
+			// The cells with min <= to are in the chunks up to and including the first one
+			// with a min > to, and the cells of each with max in (to, from] are contiguous
+			const size_t num_chunks = chunks_up_to(to);
+			const size_t last_chunk = std::min(num_chunks + 1, chunk_max_min.size());
+			compact_tiles(last_chunk, changed_cells,
+				[&](const size_t c, std::vector<size_t> &chunk_changed) {
+					const auto begin = cell_max.begin() + c * chunk_size;
+					const auto end = cell_max.begin() + std::min(cells.size(), (c + 1) * chunk_size);
+					const size_t first = std::partition_point(begin, end,
+							[&](const T m) {
+								return m > from;
+							}) - cell_max.begin();
+					const size_t last = std::partition_point(begin, end,
+							[&](const T m) {
+								return m > to;
+							}) - cell_max.begin();
+					for (size_t i = first; i < last; ++i) {
+						if (c < num_chunks || cell_min[i] <= to) {
+							chunk_changed.push_back(cells[i]);
+						}
+					}
+				});
+		}
+		tbb::parallel_sort(changed_cells.begin(), changed_cells.end());
+	}
+
+	size_t bytes() const {
+		return cells.size() * sizeof(I)
+			+ (cell_min.size() + cell_max.size() + chunk_max_min.size()) * sizeof(T);
+	}
+};
+
+// Incremental extraction for small changes of the isovalue, e.g. while dragging a slider.
+// The active voxels of the previous isovalue are kept, and on an update only the cells whose
+// case can change are reprocessed: the kept voxels are reclassified from their stored corner
+// values, dropping those which are no longer active, and the cells which become active are
+// found with a span space query for the cells whose min or max crossed the isovalue. Only
+// those new cells are read from the volume, and they're merged into the kept voxels by a
+// tiled compaction, so an update costs about as much as the active voxels and the change
+// instead of the volume. The vertex positions depend on the isovalue, so the vertices of all
+// the active voxels are regenerated. The first update runs a full span space query.
+template<typename T, typename CellId = uint32_t>
+struct IncrementalMarchingCubes {
+	const VolumeSource<T> &volume;
+	const vec3sz dims;
+	const SpanSpaceIndex<T, CellId> &index;
+	// The active voxels at the current isovalue, in order of increasing ID
+	std::vector<ActiveVoxel<T>> active_voxels;
+	float isovalue = 0;
+	bool has_isovalue = false;
+
+	// Buffers kept between updates
+	std::vector<size_t> cell_ids;
+	std::vector<ActiveVoxel<T>> new_voxels;
+	std::vector<ActiveVoxel<T>> merged_voxels;
+	CompactWorkspace<ActiveVoxel<T>> compact_workspace;
+	std::vector<uint32_t> num_verts;
+	IndexedMeshWorkspace<> indexed_workspace;
+
+	IncrementalMarchingCubes(const VolumeSource<T> &volume, const vec3sz &dims,
+			const SpanSpaceIndex<T, CellId> &index)
+		: volume(volume), dims(dims), index(index)
+	{}
+
+	// Update the active voxels to those of the new isovalue
+	void update(const float new_isovalue, ExtractionStats *stats = nullptr) {
+		if (!has_isovalue) {
+			StageTimer query_timer(stats, "span_space_query");
+			index.query(new_isovalue, cell_ids);
+			query_timer.stop(cell_ids.size() * sizeof(size_t));
+
+			StageTimer classify_timer(stats, "classify");
+			classify_voxels(volume, dims, new_isovalue, cell_ids, active_voxels);
+			classify_timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+		} else {
+			StageTimer query_timer(stats, "span_space_query_changed");
+			index.query_changed(isovalue, new_isovalue, cell_ids);
+			query_timer.stop(cell_ids.size() * sizeof(size_t));
+
+			StageTimer classify_timer(stats, "classify_changed");
+			classify_voxels(volume, dims, new_isovalue, cell_ids, new_voxels);
+			classify_timer.stop(new_voxels.size() * sizeof(ActiveVoxel<T>));
+
+			// Each tile of the kept voxels also takes the new voxels whose IDs fall between
+			// its first voxel and the next tile's, so the output stays in order of ID
+			StageTimer merge_timer(stats, "merge_active");
+			const iso_threshold_t<T> threshold = iso_threshold<T>(new_isovalue);
+			const size_t n = active_voxels.size();
+			const size_t num_tiles = std::max(size_t(1), (n + compact_tile_size - 1) / compact_tile_size);
+			const auto new_voxels_before = [&](const size_t i) {
+				return std::partition_point(new_voxels.begin(), new_voxels.end(),
+					[&](const ActiveVoxel<T> &v) {
+						return v.id < active_voxels[i].id;
+					});
+			};
+			compact_tiles(num_tiles, merged_voxels,
+				[&](const size_t t, std::vector<ActiveVoxel<T>> &buffer) {
+					const size_t begin = t * compact_tile_size;
+					const size_t end = std::min(n, begin + compact_tile_size);
+					auto new_it = t == 0 ? new_voxels.begin() : new_voxels_before(begin);
+					const auto new_end = t + 1 == num_tiles ? new_voxels.end() : new_voxels_before(end);
+					for (size_t i = begin; i < end; ++i) {
+						const ActiveVoxel<T> &active = active_voxels[i];
+						for (; new_it != new_end && new_it->id < active.id; ++new_it) {
+							buffer.push_back(*new_it);
+						}
+						const uint8_t cube_case = compute_cube_case(active.values, threshold);
+						if (cube_case != 0 && cube_case != 255) {
+							buffer.push_back(active);
+							buffer.back().cube_case = cube_case;
+						}
+					}
+					buffer.insert(buffer.end(), new_it, new_end);
+				},
+				compact_workspace);
+			std::swap(active_voxels, merged_voxels);
+			merge_timer.stop(active_voxels.size() * sizeof(ActiveVoxel<T>));
+		}
+		isovalue = new_isovalue;
+		has_isovalue = true;
+		STATS_RECORD(stats, active_voxels = active_voxels.size());
+	}
+
+	// Update to the isovalue and compute the isosurface as triangle soup
+	void extract(const float new_isovalue, std::vector<vec3f> &vertices,
+			const ScanBackend scan_backend = ScanBackend::TBB, ExtractionStats *stats = nullptr)
+	{
+		update(new_isovalue, stats);
+		extract_active_voxels(dims, isovalue, active_voxels, vertices, num_verts, scan_backend,
+				{0, 0, 0}, stats);
+	}
+
+	// Update to the isovalue and compute the isosurface as an indexed mesh
+	template<typename I>
+	void extract_indexed(const float new_isovalue, std::vector<vec3f> &vertices, std::vector<I> &indices,
+			const ScanBackend scan_backend = ScanBackend::TBB, ExtractionStats *stats = nullptr)
+	{
+		update(new_isovalue, stats);
+		extract_indexed_mesh(dims, isovalue, active_voxels, vertices, indices, indexed_workspace,
+				scan_backend, stats);
+	}
+
+	// Bytes currently held by the active voxels and workspaces
+	size_t bytes() const {
+		return (active_voxels.capacity() + new_voxels.capacity() + merged_voxels.capacity())
+				* sizeof(ActiveVoxel<T>)
+			+ cell_ids.capacity() * sizeof(size_t) + compact_workspace.bytes()
+			+ num_verts.capacity() * sizeof(uint32_t) + indexed_workspace.bytes();
+	}
+};
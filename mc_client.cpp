@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mc_server.h"
+#include "mesh_io.h"
+
+using namespace std::chrono;
+
+// Test client for the marching_cubes server. Sends the queries for all the isovalues at
+// once, so the server can answer them together, then reads the meshes and reports the
+// round trip time. Repeating the queries shows the latency once the server is warmed up.
+
+int main(int argc, char **argv) {
+#ifndef _WIN32
+	std::vector<std::string> args(argv, argv + argc);
+	std::string socket_path;
+	std::string output;
+	std::vector<float> isovalues;
+	uint32_t volume = 0;
+	uint32_t flags = 0;
+	size_t repeats = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (args[i] == "-socket") {
+			socket_path = args[++i];
+		} else if (args[i] == "-volume") {
+			volume = std::strtoul(argv[++i], nullptr, 10);
+		} else if (args[i] == "-iso") {
+			while (i + 1 < argc && (args[i + 1][0] != '-' || std::isdigit(args[i + 1][1]))) {
+				isovalues.push_back(std::atof(argv[++i]));
+			}
+		} else if (args[i] == "-indexed") {
+			flags |= mc_protocol::REQUEST_INDEXED;
+		} else if (args[i] == "-repeat") {
+			repeats = std::max(1, std::atoi(argv[++i]));
+		} else if (args[i] == "-o") {
+			output = args[++i];
+		}
+	}
+	if (socket_path.empty() || isovalues.empty()) {
+		std::cout << "Usage: " << args[0] << " -socket <path> -iso <v...>\n"
+			<< "\t-volume <i> queries the server's volume i, 0 by default\n"
+			<< "\t-indexed requests indexed meshes instead of triangle soup\n"
+			<< "\t-repeat <n> sends the queries n times, reporting each round trip\n"
+			<< "\t-o <file> writes the meshes of the last round, with _i added to the name if\n"
+			<< "\t\tthere are several isovalues\n";
+		return 1;
+	}
+
+	const int fd = mc_protocol::connect_unix_socket(socket_path);
+	if (fd < 0) {
+		std::cerr << "Failed to connect to " << socket_path << "\n";
+		return 1;
+	}
+	std::vector<std::vector<vec3f>> vertices(isovalues.size());
+	std::vector<std::vector<uint32_t>> indices(isovalues.size());
+	double total_ms = 0;
+	for (size_t r = 0; r < repeats; ++r) {
+		auto start = steady_clock::now();
+		for (const float isovalue : isovalues) {
+			mc_protocol::Request request;
+			request.volume = volume;
+			request.isovalue = isovalue;
+			request.flags = flags;
+			if (!mc_protocol::write_request(fd, request)) {
+				std::cerr << "Failed to send the request\n";
+				return 1;
+			}
+		}
+		size_t num_tris = 0;
+		for (size_t i = 0; i < isovalues.size(); ++i) {
+			std::string error;
+			if (!mc_protocol::read_response(fd, vertices[i], indices[i], error)) {
+				std::cerr << "The server closed the connection\n";
+				return 1;
+			}
+			if (!error.empty()) {
+				std::cerr << "Query at isovalue " << isovalues[i] << " failed: " << error << "\n";
+				return 1;
+			}
+			num_tris += (indices[i].empty() ? vertices[i].size() : indices[i].size()) / 3;
+		}
+		auto end = steady_clock::now();
+		const double ms = duration<double, std::milli>(end - start).count();
+		total_ms += ms;
+		std::cout << isovalues.size() << " isosurfaces with " << num_tris << " triangles received in "
+			<< ms << "ms\n";
+	}
+	close(fd);
+	std::cout << "Average round trip: " << total_ms / repeats << "ms\n";
+
+	if (!output.empty()) {
+		const MeshFormat format = mesh_format_from_path(output);
+		try {
+			for (size_t i = 0; i < isovalues.size(); ++i) {
+				std::stringstream comment;
+				comment << "Isosurface of server volume " << volume << " at isovalue " << isovalues[i];
+				write_mesh(isovalues.size() == 1 ? output : batch_output_path(output, i), format, vertices[i],
+						indices[i], comment.str());
+			}
+		} catch (const std::runtime_error &e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
+	return 0;
+#else
+	(void)argc;
+	(void)argv;
+	std::cerr << "The server is only supported on POSIX systems\n";
+	return 1;
+#endif
+}
@@ -0,0 +1,572 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/parallel_for_each.h>
+#include <tbb/scalable_allocator.h>
+#include "marching_cubes.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Resident isosurface server. The volumes are loaded once and kept, along with the
+// extraction workspaces, and isovalue queries are answered over stdin/stdout or a local
+// Unix socket. The protocol is a stream of fixed size requests, each answered by one
+// response in the order the requests were sent, so a client can send several queries
+// before reading the answers. All values are in the host's byte order, as the client
+// is on the same machine.
+//
+// Request:  uint32 volume, float32 isovalue, uint32 flags (REQUEST_INDEXED)
+// Response: uint32 status, then for STATUS_OK
+//               uint64 vertex count, uint64 index count, float32 xyz vertices, uint32 indices
+//           with no indices for triangle soup, or for STATUS_ERROR
+//               uint32 message length, message
+namespace mc_protocol {
+
+// Return the mesh as an indexed mesh instead of triangle soup
+const uint32_t REQUEST_INDEXED = 1;
+
+const uint32_t STATUS_OK = 0;
+const uint32_t STATUS_ERROR = 1;
+
+struct Request {
+	uint32_t volume = 0;
+	float isovalue = 0;
+	uint32_t flags = 0;
+};
+
+#ifndef _WIN32
+// Read exactly n bytes, returning false if the stream ends or fails first
+inline bool read_full(const int fd, void *data, const size_t n) {
+	uint8_t *dst = static_cast<uint8_t*>(data);
+	size_t done = 0;
+	while (done < n) {
+		const ssize_t r = ::read(fd, dst + done, n - done);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		done += r;
+	}
+	return true;
+}
+
+// Write exactly n bytes, returning false if the write fails
+inline bool write_full(const int fd, const void *data, const size_t n) {
+	const uint8_t *src = static_cast<const uint8_t*>(data);
+	size_t done = 0;
+	while (done < n) {
+		const ssize_t w = ::write(fd, src + done, n - done);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return false;
+		}
+		done += w;
+	}
+	return true;
+}
+
+inline bool read_request(const int fd, Request &request) {
+	uint32_t fields[3];
+	if (!read_full(fd, fields, sizeof(fields))) {
+		return false;
+	}
+	request.volume = fields[0];
+	std::memcpy(&request.isovalue, &fields[1], sizeof(float));
+	request.flags = fields[2];
+	return true;
+}
+
+inline bool write_request(const int fd, const Request &request) {
+	uint32_t fields[3] = {request.volume, 0, request.flags};
+	std::memcpy(&fields[1], &request.isovalue, sizeof(float));
+	return write_full(fd, fields, sizeof(fields));
+}
+
+inline bool write_mesh_response(const int fd, const std::vector<vec3f> &vertices,
+		const std::vector<uint32_t> &indices)
+{
+	const uint32_t status = STATUS_OK;
+	const uint64_t counts[2] = {vertices.size(), indices.size()};
+	return write_full(fd, &status, sizeof(status))
+		&& write_full(fd, counts, sizeof(counts))
+		&& write_full(fd, vertices.data(), vertices.size() * sizeof(vec3f))
+		&& write_full(fd, indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+inline bool write_error_response(const int fd, const std::string &message) {
+	const uint32_t header[2] = {STATUS_ERROR, uint32_t(message.size())};
+	return write_full(fd, header, sizeof(header)) && write_full(fd, message.data(), message.size());
+}
+
+// Read the response to a request. Returns false if the stream ends or fails, otherwise
+// error is set to the server's message if the request failed.
+inline bool read_response(const int fd, std::vector<vec3f> &vertices, std::vector<uint32_t> &indices,
+		std::string &error)
+{
+	uint32_t status = 0;
+	if (!read_full(fd, &status, sizeof(status))) {
+		return false;
+	}
+	error.clear();
+	if (status != STATUS_OK) {
+		uint32_t length = 0;
+		if (!read_full(fd, &length, sizeof(length))) {
+			return false;
+		}
+		error.resize(length);
+		return read_full(fd, &error[0], length);
+	}
+	uint64_t counts[2];
+	if (!read_full(fd, counts, sizeof(counts))) {
+		return false;
+	}
+	vertices.resize(counts[0]);
+	indices.resize(counts[1]);
+	return read_full(fd, vertices.data(), vertices.size() * sizeof(vec3f))
+		&& read_full(fd, indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+// Connect to the server listening on the Unix socket, returning the socket or -1
+inline int connect_unix_socket(const std::string &path) {
+	sockaddr_un addr = {};
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	addr.sun_family = AF_UNIX;
+	std::strcpy(addr.sun_path, path.c_str());
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+#endif
+
+}
+
+#ifndef _WIN32
+struct ServerConnection;
+
+// A query waiting to be answered and, once extracted, its mesh
+struct ServerQuery {
+	mc_protocol::Request request;
+	std::shared_ptr<ServerConnection> connection;
+	std::vector<vec3f> vertices;
+	std::vector<uint32_t> indices;
+	std::string error;
+};
+
+// A client of the server. Its requests are read from in_fd on the client's reader thread, and
+// the answered queries are queued for its writer thread, which sends the responses on out_fd
+// in the order the requests were read. The dispatcher only queues the responses, so a client
+// which reads them slowly, or stops reading them, holds up only its own queries. Sockets are
+// closed once the reader and writer are done and no queries from the client are left.
+struct ServerConnection {
+	int in_fd = -1;
+	int out_fd = -1;
+	bool owns_fds = false;
+
+	std::mutex mutex;
+	std::condition_variable responses_ready;
+	std::deque<std::unique_ptr<ServerQuery>> responses;
+	// The requests read whose responses haven't been sent yet, and whether the reader is done
+	size_t outstanding = 0;
+	bool reading_done = false;
+
+	ServerConnection(const int in_fd, const int out_fd, const bool owns_fds)
+		: in_fd(in_fd), out_fd(out_fd), owns_fds(owns_fds)
+	{}
+
+	ServerConnection(const ServerConnection &) = delete;
+	ServerConnection& operator=(const ServerConnection &) = delete;
+
+	~ServerConnection() {
+		if (owns_fds) {
+			close(in_fd);
+			if (out_fd != in_fd) {
+				close(out_fd);
+			}
+		}
+	}
+
+	// Called by the reader for each request read, before it's queued to be answered
+	void request_read() {
+		std::lock_guard<std::mutex> lock(mutex);
+		++outstanding;
+	}
+
+	// Called by the reader once the client has no more requests
+	void reader_done() {
+		std::lock_guard<std::mutex> lock(mutex);
+		reading_done = true;
+		responses_ready.notify_one();
+	}
+
+	// Queue the answered query's response to be sent by the writer
+	void queue_response(std::unique_ptr<ServerQuery> query) {
+		std::lock_guard<std::mutex> lock(mutex);
+		responses.push_back(std::move(query));
+		responses_ready.notify_one();
+	}
+
+	// Send the queued responses until the reader is done and every request read has been
+	// answered. Once a response fails to send, the remaining ones are dropped.
+	void write_responses() {
+		bool broken = false;
+		while (true) {
+			std::unique_ptr<ServerQuery> query;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				responses_ready.wait(lock, [&] {
+					return !responses.empty() || (reading_done && outstanding == 0);
+				});
+				if (responses.empty()) {
+					return;
+				}
+				query = std::move(responses.front());
+				responses.pop_front();
+			}
+			if (!broken) {
+				broken = !(query->error.empty()
+					? mc_protocol::write_mesh_response(out_fd, query->vertices, query->indices)
+					: mc_protocol::write_error_response(out_fd, query->error));
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			--outstanding;
+		}
+	}
+};
+
+// A volume kept loaded by the server. The voxel type is hidden behind the interface so
+// volumes of different types can be served together.
+class ResidentVolume {
+public:
+	virtual ~ResidentVolume() = default;
+
+	// Answer the queries, which are all on this volume, filling in their meshes or errors
+	virtual void extract(const std::vector<ServerQuery*> &queries, ScanBackend scan_backend) = 0;
+
+	virtual std::string describe() const = 0;
+};
+
+template<typename T>
+class ResidentVolumeOf : public ResidentVolume {
+	std::string fname;
+	vec3sz dims;
+	VolumeSource<T> volume;
+	MarchingCubesContext<T, tbb::scalable_allocator> context;
+
+public:
+	// Open the volume and start paging it all in, as every query reads it. Throws if the
+	// file can't be opened or is too small.
+	ResidentVolumeOf(const std::string &fname, const vec3sz &dims, const size_t workspace_cap)
+		: fname(fname), dims(dims),
+		volume(fname, dims[0] * dims[1] * dims[2], VolumeAccess::WILLNEED),
+		context(workspace_cap)
+	{}
+
+	// Soup queries are extracted together in a single pass over the volume when there are
+	// several of them, and indexed ones one after another reusing the context's workspaces
+	void extract(const std::vector<ServerQuery*> &queries, const ScanBackend scan_backend) override {
+		std::vector<ServerQuery*> soup_queries;
+		for (ServerQuery *q : queries) {
+			try {
+				if (q->request.flags & mc_protocol::REQUEST_INDEXED) {
+					context.extract_indexed(volume, dims, q->request.isovalue, q->vertices, q->indices,
+							scan_backend);
+				} else {
+					soup_queries.push_back(q);
+				}
+			} catch (const std::exception &e) {
+				q->error = e.what();
+			}
+		}
+		try {
+			if (soup_queries.size() == 1) {
+				context.extract(volume, dims, soup_queries[0]->request.isovalue, soup_queries[0]->vertices,
+						scan_backend);
+			} else if (soup_queries.size() > 1) {
+				std::vector<float> isovalues;
+				for (const ServerQuery *q : soup_queries) {
+					isovalues.push_back(q->request.isovalue);
+				}
+				std::vector<std::vector<vec3f>> meshes;
+				batch_marching_cubes(volume, dims, isovalues, meshes, scan_backend);
+				for (size_t i = 0; i < soup_queries.size(); ++i) {
+					soup_queries[i]->vertices = std::move(meshes[i]);
+				}
+			}
+		} catch (const std::exception &e) {
+			for (ServerQuery *q : soup_queries) {
+				q->error = e.what();
+			}
+		}
+	}
+
+	std::string describe() const override {
+		return fname + " (" + std::to_string(dims[0]) + "x" + std::to_string(dims[1]) + "x"
+			+ std::to_string(dims[2]) + ", " + std::to_string(sizeof(T) * 8) + "-bit voxels)";
+	}
+};
+
+// Serves the isosurface queries of any number of clients. Each client has a thread reading
+// its requests into a shared queue, and the dispatcher takes all the queries waiting in the
+// queue at once as a batch. The batch's queries are grouped by volume and the groups are
+// extracted in parallel on the TBB pool, then each response is queued on its client's
+// connection in the order the queries arrived, for the client's writer thread to send, so
+// each client gets its answers in order and the dispatcher never waits on a client.
+class IsosurfaceServer {
+	std::vector<std::unique_ptr<ResidentVolume>> volumes;
+	ScanBackend scan_backend;
+
+	std::mutex mutex;
+	std::condition_variable queries_ready;
+	std::condition_variable clients_done;
+	std::vector<std::unique_ptr<ServerQuery>> pending;
+	// Clients whose requests are still being read, clients whose responses may still be
+	// sent, and whether more may connect
+	size_t open_readers = 0;
+	size_t open_clients = 0;
+	bool accepting = false;
+
+public:
+	explicit IsosurfaceServer(const ScanBackend scan_backend = ScanBackend::TBB)
+		: scan_backend(scan_backend)
+	{}
+
+	void add_volume(std::unique_ptr<ResidentVolume> volume) {
+		std::cerr << "Volume " << volumes.size() << ": " << volume->describe() << "\n";
+		volumes.push_back(std::move(volume));
+	}
+
+	// Answer requests read from stdin on stdout until stdin is closed
+	void serve_stdio() {
+		// Responses to a client that's gone fail to write instead of killing the server
+		std::signal(SIGPIPE, SIG_IGN);
+		std::thread client = start_client(std::make_shared<ServerConnection>(STDIN_FILENO, STDOUT_FILENO, false));
+		dispatch();
+		client.join();
+	}
+
+	// Answer requests from clients connecting to the Unix socket at path. A socket left at the
+	// path by a server which is no longer running is replaced, but anything else there is kept
+	// and an error thrown, as is one if the socket can't be created. On SIGINT or SIGTERM the
+	// server stops accepting clients and removes the socket, then returns once the clients
+	// already connected have disconnected. A second signal kills it as usual.
+	void serve_socket(const std::string &path) {
+		std::signal(SIGPIPE, SIG_IGN);
+		sockaddr_un addr = {};
+		if (path.size() >= sizeof(addr.sun_path)) {
+			throw std::runtime_error("Socket path " + path + " is too long");
+		}
+		addr.sun_family = AF_UNIX;
+		std::strcpy(addr.sun_path, path.c_str());
+		remove_stale_socket(path);
+		const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+			const std::string error = std::strerror(errno);
+			if (listen_fd >= 0) {
+				close(listen_fd);
+			}
+			throw std::runtime_error("Failed to listen on " + path + ": " + error);
+		}
+		if (listen(listen_fd, 16) != 0) {
+			const std::string error = std::strerror(errno);
+			close(listen_fd);
+			unlink(path.c_str());
+			throw std::runtime_error("Failed to listen on " + path + ": " + error);
+		}
+		std::cerr << "Listening on " << path << "\n";
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			accepting = true;
+		}
+		// The handler shuts down the listening socket, which makes accept fail and ends the
+		// accept loop
+		stop_fd = listen_fd;
+		struct sigaction action = {};
+		action.sa_handler = stop_listening;
+		action.sa_flags = SA_RESETHAND;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+
+		std::thread acceptor([this, listen_fd, path] {
+			while (true) {
+				const int fd = accept(listen_fd, nullptr, nullptr);
+				if (fd < 0) {
+					if (errno == EINTR || errno == ECONNABORTED) {
+						continue;
+					}
+					break;
+				}
+				start_client(std::make_shared<ServerConnection>(fd, fd, true)).detach();
+			}
+			stop_fd = -1;
+			close(listen_fd);
+			unlink(path.c_str());
+			std::cerr << "Stopped listening on " << path << "\n";
+			std::lock_guard<std::mutex> lock(mutex);
+			accepting = false;
+			queries_ready.notify_one();
+		});
+		dispatch();
+		acceptor.join();
+		// Let the writers finish sending the last responses
+		std::unique_lock<std::mutex> lock(mutex);
+		clients_done.wait(lock, [&] {
+			return open_clients == 0;
+		});
+	}
+
+private:
+	// The listening socket to shut down on SIGINT or SIGTERM, or -1
+	static inline std::atomic<int> stop_fd{-1};
+
+	static void stop_listening(int) {
+		const int fd = stop_fd;
+		if (fd >= 0) {
+			shutdown(fd, SHUT_RDWR);
+		}
+	}
+
+	// Remove the socket at path if it was left by a server which is no longer running, i.e.,
+	// one that can't be connected to. Throws if something else is at the path, so a mistyped
+	// path can't delete a file, or if a server is still listening on it.
+	static void remove_stale_socket(const std::string &path) {
+		struct stat info;
+		if (lstat(path.c_str(), &info) != 0) {
+			if (errno == ENOENT) {
+				return;
+			}
+			throw std::runtime_error("Failed to check " + path + ": " + std::strerror(errno));
+		}
+		if (!S_ISSOCK(info.st_mode)) {
+			throw std::runtime_error("Socket path " + path + " exists and is not a socket");
+		}
+		const int fd = mc_protocol::connect_unix_socket(path);
+		if (fd >= 0) {
+			close(fd);
+			throw std::runtime_error("A server is already listening on " + path);
+		}
+		if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+			throw std::runtime_error("Failed to remove the stale socket " + path + ": " + std::strerror(errno));
+		}
+	}
+
+	// Start the client's thread, which sends its responses while a second thread reads its
+	// requests into the queue, and returns once both are done
+	std::thread start_client(std::shared_ptr<ServerConnection> connection) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++open_readers;
+			++open_clients;
+		}
+		return std::thread([this, connection] {
+			std::thread reader([this, connection] {
+				mc_protocol::Request request;
+				while (mc_protocol::read_request(connection->in_fd, request)) {
+					auto query = std::make_unique<ServerQuery>();
+					query->request = request;
+					query->connection = connection;
+					connection->request_read();
+					std::lock_guard<std::mutex> lock(mutex);
+					pending.push_back(std::move(query));
+					queries_ready.notify_one();
+				}
+				connection->reader_done();
+				std::lock_guard<std::mutex> lock(mutex);
+				--open_readers;
+				queries_ready.notify_one();
+			});
+			connection->write_responses();
+			reader.join();
+			std::lock_guard<std::mutex> lock(mutex);
+			--open_clients;
+			clients_done.notify_all();
+		});
+	}
+
+	// Answer batches of queries until no more can arrive
+	void dispatch() {
+		std::vector<std::unique_ptr<ServerQuery>> batch;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queries_ready.wait(lock, [&] {
+					return !pending.empty() || (open_readers == 0 && !accepting);
+				});
+				if (pending.empty()) {
+					return;
+				}
+				std::swap(batch, pending);
+			}
+			answer(batch);
+			batch.clear();
+		}
+	}
+
+	void answer(std::vector<std::unique_ptr<ServerQuery>> &batch) {
+		const auto start = std::chrono::steady_clock::now();
+		std::map<uint32_t, std::vector<ServerQuery*>> by_volume;
+		for (auto &q : batch) {
+			if (q->request.volume >= volumes.size()) {
+				q->error = "No volume " + std::to_string(q->request.volume) + ", the server has "
+					+ std::to_string(volumes.size());
+			} else if (!std::isfinite(q->request.isovalue)) {
+				// The extraction's thresholds are only defined for finite isovalues
+				q->error = "The isovalue must be finite";
+			} else {
+				by_volume[q->request.volume].push_back(q.get());
+			}
+		}
+		std::vector<std::pair<const uint32_t, std::vector<ServerQuery*>>*> groups;
+		for (auto &g : by_volume) {
+			groups.push_back(&g);
+		}
+		tbb::parallel_for_each(groups.begin(), groups.end(),
+			[&](std::pair<const uint32_t, std::vector<ServerQuery*>> *group) {
+				volumes[group->first]->extract(group->second, scan_backend);
+			});
+		const auto end = std::chrono::steady_clock::now();
+
+		const size_t num_queries = batch.size();
+		for (auto &q : batch) {
+			const std::shared_ptr<ServerConnection> connection = q->connection;
+			connection->queue_response(std::move(q));
+		}
+		std::cerr << "Answered " << num_queries << " queries on " << groups.size() << " volumes, extracted in "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+	}
+};
+#endif
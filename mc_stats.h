@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+// Instrumentation of the extraction pipeline. The extraction functions take an optional
+// ExtractionStats to fill out, and record nothing if it's null. Building with
+// MC_DISABLE_STATS defined compiles the recording out entirely, the struct is kept so
+// callers don't need to change but is left empty.
+#ifndef MC_DISABLE_STATS
+#define MC_STATS_ENABLED 1
+#endif
+
+struct StageStats {
+	std::string name;
+	double ms = 0;
+	// Bytes of the buffers the stage allocated
+	size_t bytes_allocated = 0;
+};
+
+struct ExtractionStats {
+	// The stages in the order they ran
+	std::vector<StageStats> stages;
+	size_t active_voxels = 0;
+	size_t vertices = 0;
+	size_t indices = 0;
+	// Peak bytes of the pipeline's working and output buffers which were live at once
+	size_t peak_bytes = 0;
+	// Bytes of the buffers currently live, used to track the peak
+	size_t live_bytes = 0;
+	// Number of parallel tasks run by each thread, indexed by TBB thread index. Each counter
+	// is on its own cache line so threads don't contend when counting.
+	struct alignas(64) TaskCounter {
+		std::atomic<size_t> count{0};
+	};
+	std::unique_ptr<TaskCounter[]> thread_tasks;
+	size_t num_threads = 0;
+
+	ExtractionStats()
+		: thread_tasks(new TaskCounter[tbb::this_task_arena::max_concurrency()]),
+		num_threads(tbb::this_task_arena::max_concurrency())
+	{}
+
+	void allocated(const size_t bytes) {
+		live_bytes += bytes;
+		peak_bytes = std::max(peak_bytes, live_bytes);
+	}
+
+	void freed(const size_t bytes) {
+		live_bytes -= std::min(bytes, live_bytes);
+	}
+
+	void count_task() {
+		const int t = tbb::this_task_arena::current_thread_index();
+		if (t >= 0 && size_t(t) < num_threads) {
+			thread_tasks[t].count.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	double total_ms() const {
+		double total = 0;
+		for (const auto &s : stages) {
+			total += s.ms;
+		}
+		return total;
+	}
+
+	std::string to_json() const {
+		std::ostringstream json;
+		json << "{\"enabled\": " <<
+#ifdef MC_STATS_ENABLED
+			"true"
+#else
+			"false"
+#endif
+			<< ", \"total_ms\": " << total_ms()
+			<< ", \"active_voxels\": " << active_voxels
+			<< ", \"vertices\": " << vertices
+			<< ", \"indices\": " << indices
+			<< ", \"peak_bytes\": " << peak_bytes
+			<< ", \"stages\": [";
+		for (size_t i = 0; i < stages.size(); ++i) {
+			json << (i > 0 ? ", " : "")
+				<< "{\"name\": \"" << stages[i].name << "\""
+				<< ", \"ms\": " << stages[i].ms
+				<< ", \"bytes_allocated\": " << stages[i].bytes_allocated << "}";
+		}
+		json << "], \"thread_tasks\": [";
+		for (size_t i = 0; i < num_threads; ++i) {
+			json << (i > 0 ? ", " : "") << thread_tasks[i].count.load();
+		}
+		json << "]}";
+		return json.str();
+	}
+};
+
+// Times a stage of the pipeline from construction until stop is called, and records it in
+// the stats along with the bytes of the buffers it allocated. Does nothing if the stats are
+// null or disabled.
+class StageTimer {
+#ifdef MC_STATS_ENABLED
+	ExtractionStats *stats;
+	const char *name;
+	std::chrono::steady_clock::time_point start;
+#endif
+
+public:
+	StageTimer(ExtractionStats *stats, const char *name)
+#ifdef MC_STATS_ENABLED
+		: stats(stats), name(name), start(std::chrono::steady_clock::now())
+#endif
+	{
+#ifndef MC_STATS_ENABLED
+		(void)stats;
+		(void)name;
+#endif
+	}
+
+	void stop(const size_t bytes_allocated = 0) {
+#ifdef MC_STATS_ENABLED
+		if (!stats) {
+			return;
+		}
+		const auto end = std::chrono::steady_clock::now();
+		StageStats stage;
+		stage.name = name;
+		stage.ms = std::chrono::duration<double, std::milli>(end - start).count();
+		stage.bytes_allocated = bytes_allocated;
+		stats->stages.push_back(stage);
+		stats->allocated(bytes_allocated);
+#else
+		(void)bytes_allocated;
+#endif
+	}
+};
+
+// Record a statistic, e.g. STATS_RECORD(stats, active_voxels = n), if stats are enabled
+// and not null
+#ifdef MC_STATS_ENABLED
+#define STATS_RECORD(stats, expr) do { if (stats) { (stats)->expr; } } while (0)
+#else
+#define STATS_RECORD(stats, expr) do { (void)(stats); } while (0)
+#endif
+
+// parallel_for over [0, n) calling f(i) for each index, which counts the tasks run by each
+// thread in the stats
+template<typename F>
+void counted_parallel_for(const size_t n, ExtractionStats *stats, F f) {
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, n),
+		[&](const tbb::blocked_range<size_t> &r) {
+			STATS_RECORD(stats, count_task());
+			for (size_t i = r.begin(); i != r.end(); ++i) {
+				f(i);
+			}
+		});
+}
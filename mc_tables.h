@@ -0,0 +1,437 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "vec.h"
+
+// Edge and triangle tables for the cases of marching cubes
+// From http://paulbourke.net/geometry/polygonise/ and
+// https://graphics.stanford.edu/~mdfisher/MarchingCubes.html
+// Each row lists the edges of the case's triangles, terminated by -1. This table is only
+// used to generate the compacted tables below at compile time.
+constexpr std::array<std::array<int, 16>, 256> tri_table = {
+	std::array<int, 16>{-1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  9,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  1,  9,  8,  3,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2, 10,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  2, 10,  9,  0,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  2, 10,  3, 10,  8,  8, 10,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  3, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  0,  8, 11,  2,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  9,  0,  2,  3, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  1,  9,  2,  9, 11, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3, 10,  1,  3, 11, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  0,  8,  1,  8, 10, 10,  8, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  3, 11,  0, 11,  9,  9, 11, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11, 10,  9, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  3,  0,  4,  7,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  8,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  4,  7,  9,  7,  1,  1,  7,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  8,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  3,  0,  4,  7,  3,  2, 10,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  9,  0,  2, 10,  9,  4,  7,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  2,  7,  7,  9,  4,  7,  2,  9,  9,  2, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 8,  4,  7,  3, 11,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7, 11,  2,  7,  2,  4,  4,  2,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  3, 11,  1,  9,  0,  8,  4,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  1,  9,  2,  9,  4,  2,  4, 11, 11,  4,  7, -1,  0,  0,  0},
+	std::array<int, 16>{10,  3, 11, 10,  1,  3,  8,  4,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  0,  0, 10,  1,  7, 10,  0,  7, 11, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 8,  4,  7,  0,  3, 11,  0, 11,  9,  9, 11, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  9,  4,  7, 11,  9,  9, 11, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  9,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  3,  0,  4,  9,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  5,  4,  0,  1,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  8,  3,  4,  3,  5,  5,  3,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  2, 10,  9,  5,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  9,  5,  8,  3,  0,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  5,  4, 10,  4,  2,  2,  4,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  8,  3,  4,  3,  2,  4,  2,  5,  5,  2, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  3, 11,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  0,  8, 11,  2,  0,  9,  5,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 5,  0,  1,  5,  4,  0,  3, 11,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  2,  8,  8,  5,  4,  2,  5,  8,  2,  1,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 3, 10,  1,  3, 11, 10,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  5,  4,  1,  0,  8,  1,  8, 10, 10,  8, 11, -1,  0,  0,  0},
+	std::array<int, 16>{10,  5, 11, 11,  0,  3, 11,  5,  0,  0,  5,  4, -1,  0,  0,  0},
+	std::array<int, 16>{ 4, 10,  5,  4,  8, 10, 10,  8, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  9,  5,  7,  8,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  9,  5,  0,  5,  3,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  0,  1,  8,  1,  7,  7,  1,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  1,  5,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  9,  5,  7,  8,  9,  1,  2, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  2, 10,  0,  9,  5,  0,  5,  3,  3,  5,  7, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  8,  5,  5,  2, 10,  8,  2,  5,  8,  0,  2, -1,  0,  0,  0},
+	std::array<int, 16>{10,  3,  2, 10,  5,  3,  3,  5,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  7,  8,  9,  5,  7, 11,  2,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  9,  2,  2,  7, 11,  2,  9,  7,  7,  9,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 3, 11,  2,  8,  0,  1,  8,  1,  7,  7,  1,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  7, 11,  2,  1,  7,  7,  1,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  1,  3, 11, 10,  1,  7,  8,  9,  7,  9,  5, -1,  0,  0,  0},
+	std::array<int, 16>{11, 10,  1, 11,  1,  7,  7,  1,  0,  7,  0,  9,  7,  9,  5, -1},
+	std::array<int, 16>{ 5,  7,  8,  5,  8, 10, 10,  8,  0, 10,  0,  3, 10,  3, 11, -1},
+	std::array<int, 16>{11, 10,  5, 11,  5,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  0,  1,  5, 10,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  1,  9,  8,  3,  1, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  1,  2,  6,  5,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  1,  2,  6,  5,  1,  0,  8,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 5,  9,  0,  5,  0,  6,  6,  0,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  5,  2,  2,  8,  3,  5,  8,  2,  5,  9,  8, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  3, 11, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0, 11,  2,  0,  8, 11,  6,  5, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  1,  9,  3, 11,  2, 10,  6,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  6,  5,  2,  1,  9,  2,  9, 11, 11,  9,  8, -1,  0,  0,  0},
+	std::array<int, 16>{11,  6,  5, 11,  5,  3,  3,  5,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  6,  8,  8,  1,  0,  8,  6,  1,  1,  6,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  3, 11,  0, 11,  6,  0,  6,  9,  9,  6,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 5, 11,  6,  5,  9, 11, 11,  9,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  8,  4,  6,  5, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  4,  7,  3,  0,  4,  5, 10,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  5, 10,  7,  8,  4,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 5, 10,  6,  9,  4,  7,  9,  7,  1,  1,  7,  3, -1,  0,  0,  0},
+	std::array<int, 16>{ 1,  6,  5,  1,  2,  6,  7,  8,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  0,  4,  7,  3,  0,  6,  5,  1,  6,  1,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  8,  5,  9,  0,  5,  0,  6,  6,  0,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  6,  5,  2,  5,  3,  3,  5,  9,  3,  9,  4,  3,  4,  7, -1},
+	std::array<int, 16>{ 4,  7,  8,  5, 10,  6, 11,  2,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  5, 10,  7, 11,  2,  7,  2,  4,  4,  2,  0, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  7,  8,  9,  0,  1,  6,  5, 10,  3, 11,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 6,  5, 10, 11,  4,  7, 11,  2,  4,  4,  2,  9,  9,  2,  1, -1},
+	std::array<int, 16>{ 7,  8,  4, 11,  6,  5, 11,  5,  3,  3,  5,  1, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  4,  7,  0,  7,  1,  1,  7, 11,  1, 11,  6,  1,  6,  5, -1},
+	std::array<int, 16>{ 4,  7,  8,  9,  6,  5,  9,  0,  6,  6,  0, 11, 11,  0,  3, -1},
+	std::array<int, 16>{ 7, 11,  4, 11,  9,  4, 11,  5,  9, 11,  6,  5, -1,  0,  0,  0},
+	std::array<int, 16>{10,  4,  9, 10,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  4,  9, 10,  6,  4,  8,  3,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1, 10,  6,  1,  6,  0,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  8,  6,  6,  1, 10,  6,  8,  1,  1,  8,  3, -1,  0,  0,  0},
+	std::array<int, 16>{ 9,  1,  2,  9,  2,  4,  4,  2,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3,  9,  1,  2,  9,  2,  4,  4,  2,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  2,  6,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  4,  8,  3,  2,  4,  4,  2,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4, 10,  6,  4,  9, 10,  2,  3, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  2,  0,  8, 11,  2,  4,  9, 10,  4, 10,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  3, 11,  1, 10,  6,  1,  6,  0,  0,  6,  4, -1,  0,  0,  0},
+	std::array<int, 16>{ 8, 11,  2,  8,  2,  4,  4,  2,  1,  4,  1, 10,  4, 10,  6, -1},
+	std::array<int, 16>{ 3, 11,  1,  1,  4,  9, 11,  4,  1, 11,  6,  4, -1,  0,  0,  0},
+	std::array<int, 16>{ 6,  4,  9,  6,  9, 11, 11,  9,  1, 11,  1,  0, 11,  0,  8, -1},
+	std::array<int, 16>{11,  0,  3, 11,  6,  0,  0,  6,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8, 11,  6,  8,  6,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  7,  8,  6,  8, 10, 10,  8,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  0,  7,  7, 10,  6,  0, 10,  7,  0,  9, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 1, 10,  6,  1,  6,  7,  1,  7,  0,  0,  7,  8, -1,  0,  0,  0},
+	std::array<int, 16>{ 6,  1, 10,  6,  7,  1,  1,  7,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  1,  8,  8,  6,  7,  8,  1,  6,  6,  1,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  3,  0,  7,  0,  6,  6,  0,  9,  6,  9,  1,  6,  1,  2, -1},
+	std::array<int, 16>{ 8,  6,  7,  8,  0,  6,  6,  0,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  6,  7,  2,  7,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  2,  3,  6,  7,  8,  6,  8, 10, 10,  8,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 9, 10,  6,  9,  6,  0,  0,  6,  7,  0,  7, 11,  0, 11,  2, -1},
+	std::array<int, 16>{ 3, 11,  2,  0,  7,  8,  0,  1,  7,  7,  1,  6,  6,  1, 10, -1},
+	std::array<int, 16>{ 6,  7, 10,  7,  1, 10,  7,  2,  1,  7, 11,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 1,  3, 11,  1, 11,  9,  9, 11,  6,  9,  6,  7,  9,  7,  8, -1},
+	std::array<int, 16>{ 6,  7, 11,  9,  1,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  0,  7,  0,  6,  7,  0, 11,  6,  0,  3, 11, -1,  0,  0,  0},
+	std::array<int, 16>{ 6,  7, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6, 11,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  0,  8, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6, 11,  7,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  8,  3,  1,  9,  8,  7,  6, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  7,  6,  2, 10,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  2, 10,  0,  8,  3, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  2, 10,  9,  0,  2, 11,  7,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  7,  6,  3,  2, 10,  3, 10,  8,  8, 10,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  7,  6,  2,  3,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  7,  6,  8,  6,  0,  0,  6,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  2,  3,  7,  6,  2,  1,  9,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  7,  9,  9,  2,  1,  9,  7,  2,  2,  7,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 6, 10,  1,  6,  1,  7,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6, 10,  1,  6,  1,  0,  6,  0,  7,  7,  0,  8, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  6,  3,  3,  9,  0,  6,  9,  3,  6, 10,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 6,  8,  7,  6, 10,  8,  8, 10,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  6, 11,  8,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  3,  0, 11,  0,  6,  6,  0,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  8,  4,  6, 11,  8,  0,  1,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  9,  3,  3,  6, 11,  9,  6,  3,  9,  4,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 8,  6, 11,  8,  4,  6, 10,  1,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2, 10,  1, 11,  3,  0, 11,  0,  6,  6,  0,  4, -1,  0,  0,  0},
+	std::array<int, 16>{11,  4,  6, 11,  8,  4,  2, 10,  9,  2,  9,  0, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  6, 11,  4, 11,  9,  9, 11,  3,  9,  3,  2,  9,  2, 10, -1},
+	std::array<int, 16>{ 3,  8,  4,  3,  4,  2,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  0,  4,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  1,  9,  3,  8,  4,  3,  4,  2,  2,  4,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 9,  2,  1,  9,  4,  2,  2,  4,  6, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6, 10,  4,  4,  3,  8,  4, 10,  3,  3, 10,  1, -1,  0,  0,  0},
+	std::array<int, 16>{ 1,  6, 10,  1,  0,  6,  6,  0,  4, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  9,  0, 10,  0,  6,  6,  0,  3,  6,  3,  8,  6,  8,  4, -1},
+	std::array<int, 16>{10,  9,  4, 10,  4,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6, 11,  7,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3,  9,  5,  4,  7,  6, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  5,  4,  0,  1,  5,  6, 11,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  6, 11,  4,  8,  3,  4,  3,  5,  5,  3,  1, -1,  0,  0,  0},
+	std::array<int, 16>{ 2, 10,  1, 11,  7,  6,  5,  4,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3,  1,  2, 10,  4,  9,  5, 11,  7,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 6, 11,  7, 10,  5,  4, 10,  4,  2,  2,  4,  0, -1,  0,  0,  0},
+	std::array<int, 16>{ 6, 11,  7,  5,  2, 10,  5,  4,  2,  2,  4,  3,  3,  4,  8, -1},
+	std::array<int, 16>{ 2,  7,  6,  2,  3,  7,  4,  9,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  9,  5,  8,  7,  6,  8,  6,  0,  0,  6,  2, -1,  0,  0,  0},
+	std::array<int, 16>{ 3,  6,  2,  3,  7,  6,  0,  1,  5,  0,  5,  4, -1,  0,  0,  0},
+	std::array<int, 16>{ 1,  5,  4,  1,  4,  2,  2,  4,  8,  2,  8,  7,  2,  7,  6, -1},
+	std::array<int, 16>{ 5,  4,  9,  6, 10,  1,  6,  1,  7,  7,  1,  3, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  9,  5,  7,  0,  8,  7,  6,  0,  0,  6,  1,  1,  6, 10, -1},
+	std::array<int, 16>{ 3,  7,  6,  3,  6,  0,  0,  6, 10,  0, 10,  5,  0,  5,  4, -1},
+	std::array<int, 16>{ 4,  8,  5,  8, 10,  5,  8,  6, 10,  8,  7,  6, -1,  0,  0,  0},
+	std::array<int, 16>{ 5,  6, 11,  5, 11,  9,  9, 11,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  9,  5,  0,  5,  6,  0,  6,  3,  3,  6, 11, -1,  0,  0,  0},
+	std::array<int, 16>{ 8,  0, 11, 11,  5,  6, 11,  0,  5,  5,  0,  1, -1,  0,  0,  0},
+	std::array<int, 16>{11,  5,  6, 11,  3,  5,  5,  3,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  1,  2,  5,  6, 11,  5, 11,  9,  9, 11,  8, -1,  0,  0,  0},
+	std::array<int, 16>{ 2, 10,  1,  3,  6, 11,  3,  0,  6,  6,  0,  5,  5,  0,  9, -1},
+	std::array<int, 16>{ 0,  2, 10,  0, 10,  8,  8, 10,  5,  8,  5,  6,  8,  6, 11, -1},
+	std::array<int, 16>{11,  3,  6,  3,  5,  6,  3, 10,  5,  3,  2, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  3,  6,  6,  9,  5,  3,  9,  6,  3,  8,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 5,  0,  9,  5,  6,  0,  0,  6,  2, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 6,  2,  3,  6,  3,  5,  5,  3,  8,  5,  8,  0,  5,  0,  1, -1},
+	std::array<int, 16>{ 6,  2,  1,  6,  1,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  9,  5,  8,  5,  3,  3,  5,  6,  3,  6, 10,  3, 10,  1, -1},
+	std::array<int, 16>{ 1,  0, 10,  0,  6, 10,  0,  5,  6,  0,  9,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  3,  8, 10,  5,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{10,  5,  6, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  5, 10, 11,  7,  5, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 5, 11,  7,  5, 10, 11,  3,  0,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  5, 10, 11,  7,  5,  9,  0,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  3,  1,  9,  8,  3,  5, 10, 11,  5, 11,  7, -1,  0,  0,  0},
+	std::array<int, 16>{ 2, 11,  7,  2,  7,  1,  1,  7,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  0,  8,  2, 11,  7,  2,  7,  1,  1,  7,  5, -1,  0,  0,  0},
+	std::array<int, 16>{ 2, 11,  0,  0,  5,  9,  0, 11,  5,  5, 11,  7, -1,  0,  0,  0},
+	std::array<int, 16>{ 9,  8,  3,  9,  3,  5,  5,  3,  2,  5,  2, 11,  5, 11,  7, -1},
+	std::array<int, 16>{10,  2,  3, 10,  3,  5,  5,  3,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 5, 10,  7,  7,  0,  8, 10,  0,  7, 10,  2,  0, -1,  0,  0,  0},
+	std::array<int, 16>{ 1,  9,  0, 10,  2,  3, 10,  3,  5,  5,  3,  7, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  5, 10,  7, 10,  8,  8, 10,  2,  8,  2,  1,  8,  1,  9, -1},
+	std::array<int, 16>{ 7,  5,  1,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  1,  0,  8,  7,  1,  1,  7,  5, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  5,  9,  0,  3,  5,  5,  3,  7, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  5,  9,  7,  9,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  5, 10,  4, 10,  8,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{11,  3, 10, 10,  4,  5, 10,  3,  4,  4,  3,  0, -1,  0,  0,  0},
+	std::array<int, 16>{ 9,  0,  1,  4,  5, 10,  4, 10,  8,  8, 10, 11, -1,  0,  0,  0},
+	std::array<int, 16>{ 3,  1,  9,  3,  9, 11, 11,  9,  4, 11,  4,  5, 11,  5, 10, -1},
+	std::array<int, 16>{ 8,  4, 11, 11,  1,  2,  4,  1, 11,  4,  5,  1, -1,  0,  0,  0},
+	std::array<int, 16>{ 5,  1,  2,  5,  2,  4,  4,  2, 11,  4, 11,  3,  4,  3,  0, -1},
+	std::array<int, 16>{11,  8,  4, 11,  4,  2,  2,  4,  5,  2,  5,  9,  2,  9,  0, -1},
+	std::array<int, 16>{ 2, 11,  3,  5,  9,  4, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  5, 10,  4, 10,  2,  4,  2,  8,  8,  2,  3, -1,  0,  0,  0},
+	std::array<int, 16>{10,  4,  5, 10,  2,  4,  4,  2,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  1,  9,  8,  2,  3,  8,  4,  2,  2,  4, 10, 10,  4,  5, -1},
+	std::array<int, 16>{10,  2,  5,  2,  4,  5,  2,  9,  4,  2,  1,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  3,  8,  4,  5,  3,  3,  5,  1, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  4,  5,  0,  5,  1, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  3,  9,  3,  5,  9,  3,  4,  5,  3,  8,  4, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  5,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  4,  9,  7,  9, 11, 11,  9, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  3,  0,  7,  4,  9,  7,  9, 11, 11,  9, 10, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  1,  4,  4, 11,  7,  1, 11,  4,  1, 10, 11, -1,  0,  0,  0},
+	std::array<int, 16>{10, 11,  7, 10,  7,  1,  1,  7,  4,  1,  4,  8,  1,  8,  3, -1},
+	std::array<int, 16>{ 2, 11,  7,  2,  7,  4,  2,  4,  1,  1,  4,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 0,  8,  3,  1,  4,  9,  1,  2,  4,  4,  2,  7,  7,  2, 11, -1},
+	std::array<int, 16>{ 7,  2, 11,  7,  4,  2,  2,  4,  0, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 7,  4, 11,  4,  2, 11,  4,  3,  2,  4,  8,  3, -1,  0,  0,  0},
+	std::array<int, 16>{ 7,  4,  3,  3, 10,  2,  3,  4, 10, 10,  4,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  0,  8,  2,  8, 10, 10,  8,  7, 10,  7,  4, 10,  4,  9, -1},
+	std::array<int, 16>{ 4,  0,  1,  4,  1,  7,  7,  1, 10,  7, 10,  2,  7,  2,  3, -1},
+	std::array<int, 16>{ 4,  8,  7,  1, 10,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9,  7,  4,  9,  1,  7,  7,  1,  3, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  7,  0,  7,  1,  0,  7,  9,  1,  7,  4,  9, -1,  0,  0,  0},
+	std::array<int, 16>{ 4,  0,  3,  4,  3,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 4,  8,  7, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  9, 10,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0, 11,  3,  0,  9, 11, 11,  9, 10, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  8,  0,  1, 10,  8,  8, 10, 11, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  1, 10,  3, 10, 11, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2,  9,  1,  2, 11,  9,  9, 11,  8, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  9,  3,  9, 11,  3,  9,  2, 11,  9,  1,  2, -1,  0,  0,  0},
+	std::array<int, 16>{11,  8,  0, 11,  0,  2, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 2, 11,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3, 10,  2,  3,  8, 10, 10,  8,  9, -1,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 9, 10,  2,  9,  2,  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 3,  8,  2,  8, 10,  2,  8,  1, 10,  8,  0,  1, -1,  0,  0,  0},
+	std::array<int, 16>{ 2,  1, 10, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 8,  9,  1,  8,  1,  3, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 1,  0,  9, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{ 0,  3,  8, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+	std::array<int, 16>{-1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+};
+
+constexpr std::array<std::array<uint8_t, 2>, 12> edge_vertices = {
+	std::array<uint8_t, 2>{0, 1},
+	std::array<uint8_t, 2>{1, 2},
+	std::array<uint8_t, 2>{2, 3},
+	std::array<uint8_t, 2>{3, 0},
+	std::array<uint8_t, 2>{4, 5},
+	std::array<uint8_t, 2>{6, 5},
+	std::array<uint8_t, 2>{6, 7},
+	std::array<uint8_t, 2>{7, 4},
+	std::array<uint8_t, 2>{0, 4},
+	std::array<uint8_t, 2>{1, 5},
+	std::array<uint8_t, 2>{2, 6},
+	std::array<uint8_t, 2>{3, 7},
+};
+
+constexpr std::array<vec3i, 8> index_to_vertex = {
+	vec3i{0, 0, 0},
+	vec3i{1, 0, 0},
+	vec3i{1, 1, 0},
+	vec3i{0, 1, 0},
+	vec3i{0, 0, 1},
+	vec3i{1, 0, 1},
+	vec3i{1, 1, 1},
+	vec3i{0, 1, 1},
+};
+
+namespace detail {
+
+constexpr std::array<uint8_t, 256> make_case_num_verts() {
+	std::array<uint8_t, 256> num_verts = {0};
+	for (size_t i = 0; i < tri_table.size(); ++i) {
+		while (num_verts[i] < 16 && tri_table[i][num_verts[i]] != -1) {
+			++num_verts[i];
+		}
+	}
+	return num_verts;
+}
+
+constexpr std::array<uint16_t, 257> make_case_edge_offsets(const std::array<uint8_t, 256> &num_verts) {
+	std::array<uint16_t, 257> offsets = {0};
+	for (size_t i = 0; i < num_verts.size(); ++i) {
+		offsets[i + 1] = offsets[i] + num_verts[i];
+	}
+	return offsets;
+}
+
+template<size_t N>
+constexpr std::array<uint8_t, N> make_case_edges(const std::array<uint16_t, 257> &offsets) {
+	std::array<uint8_t, N> edges = {0};
+	for (size_t i = 0; i < tri_table.size(); ++i) {
+		for (size_t j = 0; j < size_t(offsets[i + 1] - offsets[i]); ++j) {
+			edges[offsets[i] + j] = uint8_t(tri_table[i][j]);
+		}
+	}
+	return edges;
+}
+
+constexpr bool validate_tri_table() {
+	for (size_t i = 0; i < tri_table.size(); ++i) {
+		size_t n = 0;
+		while (n < 16 && tri_table[i][n] != -1) {
+			if (tri_table[i][n] < 0 || tri_table[i][n] >= 12) {
+				return false;
+			}
+			++n;
+		}
+		// Every case must be terminated and output whole triangles, and only the
+		// cases with all vertices on one side of the isovalue output nothing
+		if (n == 16 || n % 3 != 0 || (n == 0) != (i == 0 || i == 255)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+static_assert(detail::validate_tri_table(), "Invalid marching cubes triangle table");
+
+// The number of vertices output for each cube case
+constexpr std::array<uint8_t, 256> case_num_verts = detail::make_case_num_verts();
+
+// The most vertices output by any cube case
+constexpr uint32_t max_case_verts = 15;
+
+// The edges of case i's triangles are case_edges[case_edge_offsets[i], case_edge_offsets[i + 1]),
+// so each case's edge list is packed into at most 15 bytes
+constexpr std::array<uint16_t, 257> case_edge_offsets = detail::make_case_edge_offsets(case_num_verts);
+
+constexpr std::array<uint8_t, case_edge_offsets[256]> case_edges =
+	detail::make_case_edges<case_edge_offsets[256]>(case_edge_offsets);
+
+namespace detail {
+
+// Bit i of the offset index is set if the cube vertex is offset by one along axis i
+constexpr size_t vertex_offset_index(const vec3i &v) {
+	return v[0] | (v[1] << 1) | (v[2] << 2);
+}
+
+constexpr std::array<uint8_t, 12> make_edge_axis() {
+	std::array<uint8_t, 12> axis = {0};
+	for (size_t e = 0; e < edge_vertices.size(); ++e) {
+		const vec3i &a = index_to_vertex[edge_vertices[e][0]];
+		const vec3i &b = index_to_vertex[edge_vertices[e][1]];
+		for (size_t i = 0; i < 3; ++i) {
+			if (a[i] != b[i]) {
+				axis[e] = uint8_t(i);
+			}
+		}
+	}
+	return axis;
+}
+
+constexpr std::array<uint8_t, 12> make_edge_origin() {
+	std::array<uint8_t, 12> origin = {0};
+	for (size_t e = 0; e < edge_vertices.size(); ++e) {
+		const vec3i &a = index_to_vertex[edge_vertices[e][0]];
+		const vec3i &b = index_to_vertex[edge_vertices[e][1]];
+		origin[e] = vertex_offset_index(a) < vertex_offset_index(b) ? edge_vertices[e][0] : edge_vertices[e][1];
+	}
+	return origin;
+}
+
+constexpr std::array<std::array<uint8_t, 3>, 8> make_offset_axis_edge() {
+	std::array<std::array<uint8_t, 3>, 8> edges = {0};
+	for (size_t i = 0; i < edges.size(); ++i) {
+		for (size_t a = 0; a < 3; ++a) {
+			edges[i][a] = 12;
+		}
+	}
+	for (size_t e = 0; e < edge_vertices.size(); ++e) {
+		const vec3i &a = index_to_vertex[edge_vertices[e][0]];
+		const vec3i &b = index_to_vertex[edge_vertices[e][1]];
+		const size_t origin = vertex_offset_index(a) < vertex_offset_index(b)
+			? vertex_offset_index(a) : vertex_offset_index(b);
+		edges[origin][make_edge_axis()[e]] = uint8_t(e);
+	}
+	return edges;
+}
+
+constexpr std::array<uint16_t, 256> make_case_crossed_edges() {
+	std::array<uint16_t, 256> crossed = {0};
+	for (size_t c = 0; c < crossed.size(); ++c) {
+		for (size_t e = 0; e < edge_vertices.size(); ++e) {
+			if (((c >> edge_vertices[e][0]) & 1) != ((c >> edge_vertices[e][1]) & 1)) {
+				crossed[c] |= uint16_t(1 << e);
+			}
+		}
+	}
+	return crossed;
+}
+
+}
+
+// The axis each edge runs along
+constexpr std::array<uint8_t, 12> edge_axis = detail::make_edge_axis();
+
+// The cube vertex each edge starts from, i.e., its endpoint with the smaller coordinates
+constexpr std::array<uint8_t, 12> edge_origin = detail::make_edge_origin();
+
+// The edge starting from the cube vertex at offset (x, y, z) along each axis, indexed by
+// x | y << 1 | z << 2, or 12 if the cube has no such edge
+constexpr std::array<std::array<uint8_t, 3>, 8> offset_axis_edge = detail::make_offset_axis_edge();
+
+// The mask of edges crossed by the isosurface in each cube case
+constexpr std::array<uint16_t, 256> case_crossed_edges = detail::make_case_crossed_edges();
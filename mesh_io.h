@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include "vec.h"
+
+// Writers for the isosurface meshes. A mesh is a list of vertices and, for indexed meshes,
+// a list of triangle indices. If the indices are empty the mesh is triangle soup, where
+// every three consecutive vertices form a triangle.
+enum class MeshFormat {
+	// ASCII Wavefront OBJ
+	OBJ,
+	// Binary little-endian PLY
+	PLY,
+	// Raw dump: uint64 vertex count, uint64 index count, float32 xyz vertices, uint32 indices,
+	// all little-endian
+	RAW
+};
+
+// Number of vertices or triangles each task formats when serializing in parallel
+const size_t mesh_io_chunk_size = 1 << 16;
+
+inline bool parse_mesh_format(const std::string &name, MeshFormat &format) {
+	if (name == "obj") {
+		format = MeshFormat::OBJ;
+	} else if (name == "ply") {
+		format = MeshFormat::PLY;
+	} else if (name == "raw") {
+		format = MeshFormat::RAW;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// The output path of mesh i of a batch, which has _i inserted before the extension
+inline std::string batch_output_path(const std::string &output, const size_t i) {
+	const size_t ext = output.find_last_of('.');
+	const size_t dir = output.find_last_of("/\\");
+	const size_t split = ext != std::string::npos && (dir == std::string::npos || ext > dir)
+		? ext : output.size();
+	return output.substr(0, split) + "_" + std::to_string(i) + output.substr(split);
+}
+
+// Pick the format from the file extension, defaulting to OBJ
+inline MeshFormat mesh_format_from_path(const std::string &path) {
+	MeshFormat format = MeshFormat::OBJ;
+	const size_t dot = path.rfind('.');
+	if (dot != std::string::npos) {
+		parse_mesh_format(path.substr(dot + 1), format);
+	}
+	return format;
+}
+
+static_assert(sizeof(vec3f) == 3 * sizeof(float), "vec3f arrays must be tightly packed floats");
+
+namespace detail {
+
+inline bool host_is_little_endian() {
+	const uint16_t x = 1;
+	uint8_t b = 0;
+	std::memcpy(&b, &x, 1);
+	return b == 1;
+}
+
+// Store the 4 byte value at dst in little-endian order
+template<typename T>
+void store_le32(uint8_t *dst, const T &v) {
+	static_assert(sizeof(T) == 4, "store_le32 requires a 4 byte type");
+	uint32_t bits = 0;
+	std::memcpy(&bits, &v, 4);
+	dst[0] = bits & 0xff;
+	dst[1] = (bits >> 8) & 0xff;
+	dst[2] = (bits >> 16) & 0xff;
+	dst[3] = (bits >> 24) & 0xff;
+}
+
+// Write the array of 4 byte values in little-endian order. On little-endian hosts this is a
+// single write of the array, otherwise the values are swapped into a buffer in parallel.
+template<typename T>
+void write_le32_array(std::ofstream &fout, const T *data, const size_t n) {
+	if (host_is_little_endian()) {
+		fout.write(reinterpret_cast<const char*>(data), n * sizeof(T));
+		return;
+	}
+	std::vector<uint8_t> buffer(n * 4);
+	tbb::parallel_for(size_t(0), n,
+		[&](const size_t i) {
+			store_le32(&buffer[i * 4], data[i]);
+		});
+	fout.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
+
+// Triangle soups have no indices and may have more than 2^32 vertices
+inline uint64_t triangle_index(const std::vector<uint32_t> &indices, const size_t i) {
+	return indices.empty() ? uint64_t(i) : indices[i];
+}
+
+// Append the OBJ vertex lines of vertices [begin, end) to str
+inline void format_obj_vertices(const std::vector<vec3f> &vertices, const size_t begin, const size_t end,
+		std::string &str)
+{
+	char line[128];
+	for (size_t i = begin; i < end; ++i) {
+		const vec3f &v = vertices[i];
+		const int len = std::snprintf(line, sizeof(line), "v %g %g %g\n", v[0], v[1], v[2]);
+		str.append(line, len);
+	}
+}
+
+// Append the OBJ face lines of triangles [begin, end) to str. index_offset is added to the
+// indices, for meshes written in parts.
+inline void format_obj_faces(const std::vector<uint32_t> &indices, const size_t begin, const size_t end,
+		const uint64_t index_offset, std::string &str)
+{
+	char line[128];
+	for (size_t t = begin; t < end; ++t) {
+		const int len = std::snprintf(line, sizeof(line), "f %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+				triangle_index(indices, t * 3) + index_offset + 1,
+				triangle_index(indices, t * 3 + 1) + index_offset + 1,
+				triangle_index(indices, t * 3 + 2) + index_offset + 1);
+		str.append(line, len);
+	}
+}
+
+// Format the vertices and faces in chunks in parallel and write them in order
+inline void write_obj_chunks(std::ofstream &fout, const std::vector<vec3f> &vertices,
+		const std::vector<uint32_t> &indices, const uint64_t index_offset)
+{
+	const size_t num_indices = indices.empty() ? vertices.size() : indices.size();
+	const size_t num_tris = num_indices / 3;
+	const size_t vert_chunks = (vertices.size() + mesh_io_chunk_size - 1) / mesh_io_chunk_size;
+	const size_t tri_chunks = (num_tris + mesh_io_chunk_size - 1) / mesh_io_chunk_size;
+	std::vector<std::string> chunks(vert_chunks + tri_chunks);
+	tbb::parallel_for(size_t(0), chunks.size(),
+		[&](const size_t c) {
+			if (c < vert_chunks) {
+				format_obj_vertices(vertices, c * mesh_io_chunk_size,
+						std::min(vertices.size(), (c + 1) * mesh_io_chunk_size), chunks[c]);
+			} else {
+				const size_t tc = c - vert_chunks;
+				format_obj_faces(indices, tc * mesh_io_chunk_size,
+						std::min(num_tris, (tc + 1) * mesh_io_chunk_size), index_offset, chunks[c]);
+			}
+		});
+	for (const auto &c : chunks) {
+		fout.write(c.data(), c.size());
+	}
+}
+
+// Size in bytes of a PLY face record, a uchar vertex count followed by 3 uint32 indices
+const size_t ply_face_size = 1 + 3 * sizeof(uint32_t);
+
+// Build the PLY face records of triangles [begin, end) into faces
+inline void build_ply_faces(const std::vector<uint32_t> &indices, const size_t begin, const size_t end,
+		std::vector<uint8_t> &faces)
+{
+	faces.resize((end - begin) * ply_face_size);
+	tbb::parallel_for(tbb::blocked_range<size_t>(begin, end, mesh_io_chunk_size),
+		[&](const tbb::blocked_range<size_t> &r) {
+			for (size_t t = r.begin(); t < r.end(); ++t) {
+				uint8_t *f = &faces[(t - begin) * ply_face_size];
+				f[0] = 3;
+				for (size_t i = 0; i < 3; ++i) {
+					store_le32(f + 1 + i * 4, uint32_t(triangle_index(indices, t * 3 + i)));
+				}
+			}
+		});
+}
+
+// The PLY header for the counts. If size is non-zero the header is padded to size bytes
+// with a comment line, so a header written before the counts are known can be replaced.
+inline std::string ply_header(const uint64_t num_vertices, const uint64_t num_tris,
+		const std::string &comment, const size_t size = 0)
+{
+	std::string header = "ply\nformat binary_little_endian 1.0\n";
+	if (!comment.empty()) {
+		header += "comment " + comment + "\n";
+	}
+	const std::string elements = "element vertex " + std::to_string(num_vertices) + "\n"
+		+ "property float x\nproperty float y\nproperty float z\n"
+		+ "element face " + std::to_string(num_tris) + "\n"
+		+ "property list uchar uint vertex_indices\n"
+		+ "end_header\n";
+	const size_t padding_line = std::strlen("comment \n");
+	if (size != 0) {
+		if (header.size() + elements.size() + padding_line > size) {
+			throw std::runtime_error("PLY header doesn't fit in the space reserved for it");
+		}
+		header += "comment " + std::string(size - header.size() - elements.size() - padding_line, ' ') + "\n";
+	}
+	return header + elements;
+}
+
+// Write the RAW header of the counts
+inline void write_raw_header(std::ofstream &fout, const uint64_t num_vertices, const uint64_t num_indices) {
+	uint8_t header[16] = {0};
+	const uint64_t counts[2] = {num_vertices, num_indices};
+	for (size_t i = 0; i < 2; ++i) {
+		store_le32(header + i * 8, uint32_t(counts[i] & 0xffffffff));
+		store_le32(header + i * 8 + 4, uint32_t(counts[i] >> 32));
+	}
+	fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+// Flush and close the file, throwing if any write to it failed, e.g. because the disk is full,
+// so a truncated mesh isn't left behind silently
+inline void close_mesh_file(std::ofstream &fout, const std::string &path) {
+	fout.close();
+	if (!fout) {
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
+
+}
+
+// Write the mesh as ASCII OBJ. Chunks of vertices and faces are formatted into separate
+// strings in parallel, which are then written in order.
+inline void write_obj(const std::string &path, const std::vector<vec3f> &vertices,
+		const std::vector<uint32_t> &indices, const std::string &comment = "")
+{
+	std::ofstream fout(path.c_str(), std::ios::binary);
+	if (!fout) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	if (!comment.empty()) {
+		fout << "# " << comment << "\n";
+	}
+	detail::write_obj_chunks(fout, vertices, indices, 0);
+	detail::close_mesh_file(fout, path);
+}
+
+// Write the mesh as binary little-endian PLY. The vertices are written directly from the
+// vertex array and the face records are built in parallel into one buffer.
+inline void write_ply(const std::string &path, const std::vector<vec3f> &vertices,
+		const std::vector<uint32_t> &indices, const std::string &comment = "")
+{
+	const size_t num_indices = indices.empty() ? vertices.size() : indices.size();
+	const size_t num_tris = num_indices / 3;
+	if (indices.empty() && vertices.size() > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("PLY faces can't index more than 2^32 vertices, write the mesh as OBJ or RAW");
+	}
+
+	std::vector<uint8_t> faces;
+	detail::build_ply_faces(indices, 0, num_tris, faces);
+
+	std::ofstream fout(path.c_str(), std::ios::binary);
+	if (!fout) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	fout << detail::ply_header(vertices.size(), num_tris, comment);
+	detail::write_le32_array(fout, vertices.empty() ? nullptr : vertices[0].data(), vertices.size() * 3);
+	fout.write(reinterpret_cast<const char*>(faces.data()), faces.size());
+	detail::close_mesh_file(fout, path);
+}
+
+// Write the mesh as a raw little-endian dump, see MeshFormat::RAW
+inline void write_raw(const std::string &path, const std::vector<vec3f> &vertices,
+		const std::vector<uint32_t> &indices)
+{
+	std::ofstream fout(path.c_str(), std::ios::binary);
+	if (!fout) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+	detail::write_raw_header(fout, vertices.size(), indices.size());
+	detail::write_le32_array(fout, vertices.empty() ? nullptr : vertices[0].data(), vertices.size() * 3);
+	detail::write_le32_array(fout, indices.data(), indices.size());
+	detail::close_mesh_file(fout, path);
+}
+
+inline void write_mesh(const std::string &path, const MeshFormat format,
+		const std::vector<vec3f> &vertices, const std::vector<uint32_t> &indices,
+		const std::string &comment = "")
+{
+	switch (format) {
+	case MeshFormat::OBJ: write_obj(path, vertices, indices, comment); break;
+	case MeshFormat::PLY: write_ply(path, vertices, indices, comment); break;
+	case MeshFormat::RAW: write_raw(path, vertices, indices); break;
+	}
+}
+
+// Writes a triangle soup mesh part by part as it's produced, e.g. slab by slab by a pipelined
+// extraction, so the whole mesh never has to be held in memory. OBJ files are written as they
+// go, with each part's faces following its vertices. PLY and RAW files need the counts in
+// their header, so a placeholder header is written first and replaced by close, which also
+// writes the PLY faces after all the vertices. The file is only complete once closed.
+class MeshStreamWriter {
+	std::ofstream fout;
+	std::string path;
+	MeshFormat format;
+	std::string comment;
+	uint64_t num_vertices = 0;
+	size_t header_size = 0;
+
+public:
+	MeshStreamWriter(const std::string &path, const MeshFormat format, const std::string &comment = "")
+		: fout(path.c_str(), std::ios::binary), path(path), format(format), comment(comment)
+	{
+		if (!fout) {
+			throw std::runtime_error("Failed to open " + path);
+		}
+		switch (format) {
+		case MeshFormat::OBJ:
+			if (!comment.empty()) {
+				fout << "# " << comment << "\n";
+			}
+			break;
+		case MeshFormat::PLY: {
+			// Reserve room for the largest counts and the padding comment line
+			const uint64_t max_count = std::numeric_limits<uint64_t>::max();
+			header_size = detail::ply_header(max_count, max_count, comment).size() + std::strlen("comment \n");
+			fout << detail::ply_header(0, 0, comment, header_size);
+			break;
+		}
+		case MeshFormat::RAW:
+			detail::write_raw_header(fout, 0, 0);
+			break;
+		}
+	}
+
+	// Append the triangles of the soup vertices to the mesh
+	void append(const std::vector<vec3f> &vertices) {
+		if (format == MeshFormat::OBJ) {
+			detail::write_obj_chunks(fout, vertices, {}, num_vertices);
+		} else {
+			detail::write_le32_array(fout, vertices.empty() ? nullptr : vertices[0].data(), vertices.size() * 3);
+		}
+		num_vertices += vertices.size();
+		if (!fout) {
+			throw std::runtime_error("Failed to write " + path);
+		}
+	}
+
+	// Finish the file, writing the PLY faces and the final header
+	void close() {
+		if (format == MeshFormat::PLY) {
+			if (num_vertices > std::numeric_limits<uint32_t>::max()) {
+				throw std::runtime_error("PLY faces can't index more than 2^32 vertices, write the mesh as OBJ or RAW");
+			}
+			// The faces of the soup are the same for any vertices, so they're built in chunks
+			// from an empty index list
+			const size_t num_tris = num_vertices / 3;
+			std::vector<uint8_t> faces;
+			for (size_t t = 0; t < num_tris; t += mesh_io_chunk_size) {
+				detail::build_ply_faces({}, t, std::min(num_tris, t + mesh_io_chunk_size), faces);
+				fout.write(reinterpret_cast<const char*>(faces.data()), faces.size());
+			}
+		}
+		// Only fill in the counts once the body is known to be complete
+		fout.flush();
+		if (!fout) {
+			throw std::runtime_error("Failed to write " + path);
+		}
+		if (format == MeshFormat::PLY) {
+			const size_t num_tris = num_vertices / 3;
+			fout.seekp(0);
+			fout << detail::ply_header(num_vertices, num_tris, comment, header_size);
+		} else if (format == MeshFormat::RAW) {
+			fout.seekp(0);
+			detail::write_raw_header(fout, num_vertices, 0);
+		}
+		detail::close_mesh_file(fout, path);
+	}
+
+	uint64_t vertices_written() const {
+		return num_vertices;
+	}
+};
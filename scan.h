@@ -1,50 +1,717 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <type_traits>
 #include <tbb/tbb.h>
 #include <tbb/parallel_for.h>
+#include "scan_simd.h"
 
-template<typename T, typename Op>
-T inclusive_scan(const std::vector<T> &in, const T &id, std::vector<T> &out, Op op) {
-	out.resize(in.size(), id);
-	using range_type = tbb::blocked_range<size_t>;
-	T sum = tbb::parallel_scan(range_type(0, in.size()), id,
-		[&](const range_type &r, T sum, bool is_final_scan) {
-			T tmp = sum;
-			for (size_t i = r.begin(); i < r.end(); ++i) {
-				tmp = op(tmp, in[i]);
-				if (is_final_scan) {
-					out[i] = tmp;
+// Selects the parallel algorithm used to compute a scan
+enum class ScanBackend {
+	// tbb::parallel_scan, which may run the body twice: a pre-scan pass and a final pass
+	TBB,
+	// Single-pass scan over tiles which chain their prefixes through decoupled look-back,
+	// reading the input from memory once
+	DECOUPLED_LOOKBACK
+};
+
+namespace detail {
+
+// Number of elements processed by each tile of the decoupled look-back scan,
+// chosen so that a tile of 4 byte elements stays resident in L1 between its
+// reduction and its scan
+const size_t scan_tile_size = 4096;
+
+enum TileStatus : uint8_t {
+	// The tile has not published anything yet
+	TILE_INVALID,
+	// The tile's aggregate (the reduction of its own elements) is available
+	TILE_AGGREGATE,
+	// The tile's inclusive prefix (the reduction of all elements up to and including it) is available
+	TILE_PREFIX
+};
+
+template<typename T>
+struct alignas(64) TileDescriptor {
+	std::atomic<uint8_t> status{TILE_INVALID};
+	T aggregate;
+	T inclusive_prefix;
+};
+
+// Single-pass scan using decoupled look-back, see Merrill and Garland,
+// "Single-pass Parallel Prefix Scan with Decoupled Look-back", 2016.
+// reduce_tile(begin, end, id) must return the reduction of the tile's elements and
+// scan_tile(begin, end, carry) must write the tile's output given the reduction
+// of all preceding elements. Returns the reduction of all n elements.
+template<typename T, typename Op, typename ReduceTile, typename ScanTile>
+T lookback_scan(const size_t n, const T &id, Op op, ReduceTile reduce_tile, ScanTile scan_tile) {
+	if (n <= scan_tile_size) {
+		const T aggregate = reduce_tile(size_t(0), n, id);
+		scan_tile(size_t(0), n, id);
+		return aggregate;
+	}
+
+	const size_t num_tiles = (n + scan_tile_size - 1) / scan_tile_size;
+	std::unique_ptr<TileDescriptor<T>[]> tiles(new TileDescriptor<T>[num_tiles]);
+
+	// Tiles are handed out in order from a shared counter instead of by the
+	// task scheduler, so any tile we look back on has been claimed by a thread
+	// which is actively working on it and will publish its aggregate
+	std::atomic<size_t> next_tile{0};
+	const size_t num_workers = std::min(num_tiles,
+			size_t(tbb::this_task_arena::max_concurrency()));
+	tbb::parallel_for(size_t(0), num_workers,
+		[&](const size_t) {
+			size_t t = 0;
+			while ((t = next_tile.fetch_add(1)) < num_tiles) {
+				const size_t begin = t * scan_tile_size;
+				const size_t end = std::min(begin + scan_tile_size, n);
+				TileDescriptor<T> &tile = tiles[t];
+
+				const T aggregate = reduce_tile(begin, end, id);
+				if (t == 0) {
+					tile.inclusive_prefix = aggregate;
+					tile.status.store(TILE_PREFIX, std::memory_order_release);
+					scan_tile(begin, end, id);
+					continue;
+				}
+				tile.aggregate = aggregate;
+				tile.status.store(TILE_AGGREGATE, std::memory_order_release);
+
+				// Walk back over the preceding tiles, accumulating their aggregates
+				// until we find one which has its inclusive prefix available
+				T exclusive = id;
+				for (size_t p = t; p-- > 0;) {
+					const TileDescriptor<T> &pred = tiles[p];
+					uint8_t status = TILE_INVALID;
+					while ((status = pred.status.load(std::memory_order_acquire)) == TILE_INVALID) {
+						std::this_thread::yield();
+					}
+					if (status == TILE_PREFIX) {
+						exclusive = op(pred.inclusive_prefix, exclusive);
+						break;
+					}
+					exclusive = op(pred.aggregate, exclusive);
 				}
+				tile.inclusive_prefix = op(exclusive, aggregate);
+				tile.status.store(TILE_PREFIX, std::memory_order_release);
+
+				scan_tile(begin, end, exclusive);
+			}
+		});
+	return tiles[num_tiles - 1].inclusive_prefix;
+}
+
+template<typename It, typename T>
+struct is_pointer_to : std::integral_constant<bool, std::is_pointer<It>::value
+	&& std::is_same<typename std::remove_cv<typename std::remove_pointer<It>::type>::type, T>::value>
+{};
+
+// Scans with std::plus over contiguous arrays of types which have SIMD kernels
+// use them for the per-range loops
+template<typename T, typename Op, typename... Its>
+struct use_add_kernels : std::integral_constant<bool, simd::has_add_kernels<T>::value
+	&& (std::is_same<Op, std::plus<T>>::value || std::is_same<Op, std::plus<>>::value)
+	&& (is_pointer_to<Its, T>::value && ...)>
+{};
+
+// Vector iterators are unwrapped to pointers so the scans over them can use the SIMD kernels.
+// it must be dereferenceable.
+template<typename It>
+auto unwrap_iterator(It it) {
+	using value_type = typename std::iterator_traits<It>::value_type;
+	if constexpr (!std::is_same<value_type, bool>::value
+			&& (std::is_same<It, typename std::vector<value_type>::iterator>::value
+				|| std::is_same<It, typename std::vector<value_type>::const_iterator>::value))
+	{
+		return &*it;
+	} else {
+		return it;
+	}
+}
+
+// Returns carry combined with each element of in[0, n)
+template<typename InIt, typename T, typename Op>
+T reduce_range(InIt in, const size_t n, T carry, Op op) {
+	if constexpr (use_add_kernels<T, Op, InIt>::value) {
+		return carry + simd::reduce_add(in, n);
+	} else {
+		for (size_t i = 0; i < n; ++i) {
+			carry = op(carry, in[i]);
+		}
+		return carry;
+	}
+}
+
+// Inclusive scan of in[0, n) into out starting from carry, returns the carry out
+template<typename InIt, typename OutIt, typename T, typename Op>
+T inclusive_scan_range(InIt in, OutIt out, const size_t n, T carry, Op op) {
+	if constexpr (use_add_kernels<T, Op, InIt, OutIt>::value) {
+		return simd::inclusive_scan_add(static_cast<const T*>(in), out, n, carry);
+	} else {
+		for (size_t i = 0; i < n; ++i) {
+			carry = op(carry, in[i]);
+			out[i] = carry;
+		}
+		return carry;
+	}
+}
+
+// Exclusive scan of in[0, n) into out starting from carry, returns the carry out
+template<typename InIt, typename OutIt, typename T, typename Op>
+T exclusive_scan_range(InIt in, OutIt out, const size_t n, T carry, Op op) {
+	if constexpr (use_add_kernels<T, Op, InIt, OutIt>::value) {
+		return simd::exclusive_scan_add(static_cast<const T*>(in), out, n, carry);
+	} else {
+		for (size_t i = 0; i < n; ++i) {
+			const T x = in[i];
+			out[i] = carry;
+			carry = op(carry, x);
+		}
+		return carry;
+	}
+}
+
+template<bool inclusive, typename InIt, typename OutIt, typename T, typename Op>
+T scan_range(InIt in, OutIt out, const size_t n, const T &carry, Op op) {
+	if constexpr (inclusive) {
+		return inclusive_scan_range(in, out, n, carry, op);
+	} else {
+		return exclusive_scan_range(in, out, n, carry, op);
+	}
+}
+
+// Runs a scan with the selected backend. reduce_tile(begin, end, carry) must return carry
+// combined with the reduction of the elements in [begin, end), and scan_tile(begin, end, carry)
+// must write the outputs for [begin, end) and return the carry out.
+template<typename T, typename Op, typename ReduceTile, typename ScanTile>
+T scan_tiles(const size_t n, const T &id, Op op, const ScanBackend backend,
+		ReduceTile reduce_tile, ScanTile scan_tile)
+{
+	if (backend == ScanBackend::DECOUPLED_LOOKBACK) {
+		return lookback_scan(n, id, op, reduce_tile, scan_tile);
+	}
+
+	using range_type = tbb::blocked_range<size_t>;
+	return tbb::parallel_scan(range_type(0, n), id,
+		[&](const range_type &r, const T &sum, bool is_final_scan) {
+			if (is_final_scan) {
+				return scan_tile(r.begin(), r.end(), sum);
 			}
-			return tmp;
+			return reduce_tile(r.begin(), r.end(), sum);
 		},
 		[&](const T &a, const T &b) {
 			return op(a, b);
 		});
-	return sum;
 }
 
+template<bool inclusive, typename InIt, typename OutIt, typename T, typename Op>
+T scan(InIt in, OutIt out, const size_t n, const T &id, Op op, const ScanBackend backend) {
+	return scan_tiles(n, id, op, backend,
+		[&](const size_t begin, const size_t end, const T &carry) {
+			return reduce_range(in + begin, end - begin, carry, op);
+		},
+		[&](const size_t begin, const size_t end, const T &carry) {
+			return scan_range<inclusive>(in + begin, out + begin, end - begin, carry, op);
+		});
+}
+
+// The running value of a segmented scan, which is reset by a segment head
+template<typename T>
+struct SegmentedValue {
+	T value;
+	bool head;
+};
+
+// The operator of a segmented scan, which is associative if op is
 template<typename T, typename Op>
-T exclusive_scan(const std::vector<T> &in, const T &id, std::vector<T> &out, Op op) {
-	// Exclusive scan is the same as inclusive, but shifted by one
-	out.resize(in.size() + 1, id);
-	using range_type = tbb::blocked_range<size_t>;
-	T sum = tbb::parallel_scan(range_type(0, in.size()), id,
-		[&](const range_type &r, T sum, bool is_final_scan) {
-			T tmp = sum;
-			for (size_t i = r.begin(); i < r.end(); ++i) {
-				tmp = op(tmp, in[i]);
-				if (is_final_scan) {
-					out[i + 1] = tmp;
-				}
+SegmentedValue<T> combine_segmented(const SegmentedValue<T> &a, const SegmentedValue<T> &b, Op op) {
+	if (b.head) {
+		return b;
+	}
+	return SegmentedValue<T>{op(a.value, b.value), a.head};
+}
+
+// Head flag cursors for segmented scans. A cursor is created at the start of a range
+// and is called with each index of the range in order, returning if it starts a segment.
+template<typename FlagIt>
+struct FlagHeads {
+	FlagIt flags;
+
+	struct Cursor {
+		FlagIt flags;
+
+		bool operator()(const size_t i) {
+			return flags[i] != 0;
+		}
+		bool ends_segment(const size_t) const {
+			return false;
+		}
+		size_t segment() const {
+			return 0;
+		}
+	};
+
+	Cursor cursor(const size_t) const {
+		return Cursor{flags};
+	}
+};
+
+// Segments given by a sorted array of their start offsets. Empty segments are allowed,
+// and elements before the first offset form a segment which is not indexed.
+template<typename OffsetIt>
+struct OffsetHeads {
+	OffsetIt first;
+	OffsetIt last;
+	size_t n;
+
+	struct Cursor {
+		OffsetIt first;
+		OffsetIt next;
+		OffsetIt last;
+		size_t n;
+
+		bool operator()(const size_t i) {
+			bool head = false;
+			while (next != last && size_t(*next) == i) {
+				head = true;
+				++next;
 			}
-			return tmp;
+			return head;
+		}
+		// If element i, which was just passed to the cursor, is the last element of its segment
+		bool ends_segment(const size_t i) const {
+			return next != first && (i + 1 == n || (next != last && size_t(*next) == i + 1));
+		}
+		// The index of the segment containing the last element passed to the cursor
+		size_t segment() const {
+			return std::distance(first, next) - 1;
+		}
+	};
+
+	Cursor cursor(const size_t begin) const {
+		OffsetIt next = std::lower_bound(first, last, begin,
+			[](const typename std::iterator_traits<OffsetIt>::value_type &o, const size_t i) {
+				return size_t(o) < i;
+			});
+		return Cursor{first, next, last, n};
+	}
+};
+
+// Segmented scan over the segments given by heads. Each segment is scanned independently,
+// but all segments are processed together in a single parallel scan. on_segment_end(s, total)
+// is called with the total of each segment whose index the heads cursor can provide.
+template<bool inclusive, typename InIt, typename OutIt, typename T, typename Op, typename Heads,
+	typename SegmentEnd>
+T segmented_scan(InIt in, OutIt out, const size_t n, const T &id, Op op, const ScanBackend backend,
+		const Heads &heads, SegmentEnd on_segment_end)
+{
+	using value_type = SegmentedValue<T>;
+	auto seg_op = [&](const value_type &a, const value_type &b) {
+		return combine_segmented(a, b, op);
+	};
+	const value_type result = scan_tiles(n, value_type{id, false}, seg_op, backend,
+		[&](const size_t begin, const size_t end, value_type carry) {
+			auto cursor = heads.cursor(begin);
+			for (size_t i = begin; i < end; ++i) {
+				carry = seg_op(carry, value_type{in[i], cursor(i)});
+			}
+			return carry;
 		},
-		[&](const T &a, const T &b) {
-			return op(a, b);
+		[&](const size_t begin, const size_t end, value_type carry) {
+			auto cursor = heads.cursor(begin);
+			for (size_t i = begin; i < end; ++i) {
+				const value_type x{in[i], cursor(i)};
+				if constexpr (inclusive) {
+					carry = seg_op(carry, x);
+					out[i] = carry.value;
+				} else {
+					out[i] = x.head ? id : carry.value;
+					carry = seg_op(carry, x);
+				}
+				if (cursor.ends_segment(i)) {
+					on_segment_end(cursor.segment(), carry.value);
+				}
+			}
+			return carry;
+		});
+	return result.value;
+}
+
+}
+
+// Inclusive scan of [first, last) into out, which must have room for last - first elements.
+// The iterators must be random access, and out may be first to scan in place.
+// Returns the reduction of all the elements. Note that std::inclusive_scan is also found
+// through ADL for standard library iterators, so calls which don't pass a backend should be
+// qualified as ::inclusive_scan.
+template<typename InputIt, typename OutputIt, typename T, typename Op>
+T inclusive_scan(InputIt first, InputIt last, OutputIt out, const T &id, Op op,
+		ScanBackend backend = ScanBackend::TBB)
+{
+	if (first == last) {
+		return id;
+	}
+	return detail::scan<true>(detail::unwrap_iterator(first), detail::unwrap_iterator(out),
+			size_t(last - first), id, op, backend);
+}
+
+// Exclusive scan of [first, last) into out, which must have room for last - first elements.
+// The iterators must be random access, and out may be first to scan in place.
+// Returns the reduction of all the elements, i.e., the total which would follow the last output.
+// As with inclusive_scan, calls which don't pass a backend should be qualified as ::exclusive_scan.
+template<typename InputIt, typename OutputIt, typename T, typename Op>
+T exclusive_scan(InputIt first, InputIt last, OutputIt out, const T &id, Op op,
+		ScanBackend backend = ScanBackend::TBB)
+{
+	if (first == last) {
+		return id;
+	}
+	return detail::scan<false>(detail::unwrap_iterator(first), detail::unwrap_iterator(out),
+			size_t(last - first), id, op, backend);
+}
+
+template<typename T, typename Op>
+T inclusive_scan(const std::vector<T> &in, const T &id, std::vector<T> &out, Op op,
+		ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	return inclusive_scan(in.begin(), in.end(), out.begin(), id, op, backend);
+}
+
+template<typename T, typename Op>
+T exclusive_scan(const std::vector<T> &in, const T &id, std::vector<T> &out, Op op,
+		ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	return exclusive_scan(in.begin(), in.end(), out.begin(), id, op, backend);
+}
+
+// Number of elements each tile of compact_indices and compact_if tests
+const size_t compact_tile_size = 16384;
+
+// Buffers used by compact_tiles, which can be kept and passed to later compactions so
+// they reuse the memory instead of allocating it again. A is the allocator of the per-thread
+// output buffers, the other buffers use it rebound to their element types.
+template<typename T, typename A = std::allocator<T>>
+struct CompactWorkspace {
+	using Buffer = std::vector<T, A>;
+	struct TileOutput {
+		const Buffer *buffer = nullptr;
+		size_t begin = 0;
+	};
+	using TileOutputAllocator = typename std::allocator_traits<A>::template rebind_alloc<TileOutput>;
+	using SizeAllocator = typename std::allocator_traits<A>::template rebind_alloc<size_t>;
+
+	tbb::enumerable_thread_specific<Buffer> buffers;
+	std::vector<TileOutput, TileOutputAllocator> tile_outputs;
+	std::vector<size_t, SizeAllocator> offsets;
+
+	// Bytes currently held by the workspace
+	size_t bytes() const {
+		size_t total = tile_outputs.capacity() * sizeof(TileOutput) + offsets.capacity() * sizeof(size_t);
+		for (const auto &b : buffers) {
+			total += b.capacity() * sizeof(T);
+		}
+		return total;
+	}
+
+	// Free the memory held by the workspace
+	void release() {
+		buffers.clear();
+		tile_outputs = decltype(tile_outputs)();
+		offsets = decltype(offsets)();
+	}
+};
+
+namespace detail {
+
+// Runs the compaction of compact_tiles, leaving where each tile's outputs start in out in
+// tile_starts
+template<typename T, typename OutAlloc, typename A, typename Starts, typename EmitTile>
+size_t compact_tiles(const size_t num_tiles, std::vector<T, OutAlloc> &out, Starts &tile_starts,
+		EmitTile emit_tile, CompactWorkspace<T, A> &workspace)
+{
+	for (auto &b : workspace.buffers) {
+		b.clear();
+	}
+	// Every entry is written below, so only entries beyond the previous size are zeroed
+	auto &tile_outputs = workspace.tile_outputs;
+	tile_outputs.resize(num_tiles);
+	tile_starts.resize(num_tiles);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, num_tiles),
+		[&](const tbb::blocked_range<size_t> &r) {
+			auto &buffer = workspace.buffers.local();
+			for (size_t t = r.begin(); t < r.end(); ++t) {
+				tile_outputs[t].buffer = &buffer;
+				tile_outputs[t].begin = buffer.size();
+				emit_tile(t, buffer);
+				tile_starts[t] = buffer.size() - tile_outputs[t].begin;
+			}
+		});
+
+	const size_t total = ::exclusive_scan(tile_starts.begin(), tile_starts.end(), tile_starts.begin(),
+			size_t(0), std::plus<size_t>{});
+	out.resize(total);
+	tbb::parallel_for(size_t(0), num_tiles,
+		[&](const size_t t) {
+			const size_t count = (t + 1 < num_tiles ? tile_starts[t + 1] : total) - tile_starts[t];
+			const auto begin = tile_outputs[t].buffer->begin() + tile_outputs[t].begin;
+			std::copy(begin, begin + count, out.begin() + tile_starts[t]);
+		});
+	return total;
+}
+
+}
+
+// Stream compaction over tiles. emit_tile(tile, buffer) appends the tile's outputs to the
+// per-thread buffer, a std::vector<T, A>, which is shared by all tiles run on the same
+// thread. The outputs of every tile are then scattered into out in tile order, so only the
+// emitted elements are ever copied and no flag or offset array the size of the input is
+// built. The buffers are kept in the workspace for reuse by later calls.
+// Returns the number of elements written to out.
+template<typename T, typename OutAlloc, typename A, typename EmitTile>
+size_t compact_tiles(const size_t num_tiles, std::vector<T, OutAlloc> &out, EmitTile emit_tile,
+		CompactWorkspace<T, A> &workspace)
+{
+	return detail::compact_tiles(num_tiles, out, workspace.offsets, emit_tile, workspace);
+}
+
+// Stream compaction over tiles as above, which also fills tile_starts with the offset in out
+// of each tile's first output, e.g. to process the outputs tile by tile afterwards
+template<typename T, typename OutAlloc, typename A, typename EmitTile>
+size_t compact_tiles(const size_t num_tiles, std::vector<T, OutAlloc> &out, std::vector<size_t> &tile_starts,
+		EmitTile emit_tile, CompactWorkspace<T, A> &workspace)
+{
+	return detail::compact_tiles(num_tiles, out, tile_starts, emit_tile, workspace);
+}
+
+// Stream compaction over tiles using temporary buffers, see above. The buffers passed to
+// emit_tile are std::vector<T>.
+template<typename T, typename OutAlloc, typename EmitTile>
+size_t compact_tiles(const size_t num_tiles, std::vector<T, OutAlloc> &out, EmitTile emit_tile) {
+	CompactWorkspace<T> workspace;
+	return compact_tiles(num_tiles, out, emit_tile, workspace);
+}
+
+// Writes the indices i in [0, n) for which pred(i) is true to out, in increasing order
+template<typename Index, typename Pred>
+size_t compact_indices(const size_t n, std::vector<Index> &out, Pred pred) {
+	const size_t num_tiles = (n + compact_tile_size - 1) / compact_tile_size;
+	return compact_tiles(num_tiles, out,
+		[&](const size_t t, std::vector<Index> &buffer) {
+			const size_t end = std::min(n, (t + 1) * compact_tile_size);
+			for (size_t i = t * compact_tile_size; i < end; ++i) {
+				if (pred(i)) {
+					buffer.push_back(Index(i));
+				}
+			}
+		});
+}
+
+// Stream compaction over tiles into segments, e.g., the outputs of each query of a batch.
+// emit_tile(tile, buffers) appends the tile's outputs for segment s to buffers[s], one of
+// the std::vector<T> per-thread buffers shared by all tiles run on the same thread. The
+// outputs are scattered into out grouped by segment, in tile order within each segment,
+// and segment s starts at out[segment_starts[s]]. Returns the number of elements written.
+template<typename T, typename EmitTile>
+size_t compact_tiles_segmented(const size_t num_tiles, const size_t num_segments, std::vector<T> &out,
+		std::vector<size_t> &segment_starts, EmitTile emit_tile)
+{
+	using Buffers = std::vector<std::vector<T>>;
+	struct TileOutput {
+		const std::vector<T> *buffer = nullptr;
+		size_t begin = 0;
+	};
+	tbb::enumerable_thread_specific<Buffers> buffers{Buffers(num_segments)};
+	// The outputs of each tile are indexed segment major, so scanning their counts gives
+	// their offsets in the grouped output
+	std::vector<TileOutput> tile_outputs(num_segments * num_tiles);
+	std::vector<size_t> offsets(num_segments * num_tiles);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, num_tiles),
+		[&](const tbb::blocked_range<size_t> &r) {
+			Buffers &local = buffers.local();
+			for (size_t t = r.begin(); t < r.end(); ++t) {
+				for (size_t s = 0; s < num_segments; ++s) {
+					tile_outputs[s * num_tiles + t] = TileOutput{&local[s], local[s].size()};
+				}
+				emit_tile(t, local);
+				for (size_t s = 0; s < num_segments; ++s) {
+					offsets[s * num_tiles + t] = local[s].size() - tile_outputs[s * num_tiles + t].begin;
+				}
+			}
+		});
+
+	const size_t total = ::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(),
+			size_t(0), std::plus<size_t>{});
+	segment_starts.resize(num_segments);
+	for (size_t s = 0; s < num_segments; ++s) {
+		segment_starts[s] = num_tiles > 0 ? offsets[s * num_tiles] : 0;
+	}
+	out.resize(total);
+	tbb::parallel_for(size_t(0), offsets.size(),
+		[&](const size_t i) {
+			const size_t count = (i + 1 < offsets.size() ? offsets[i + 1] : total) - offsets[i];
+			const auto begin = tile_outputs[i].buffer->begin() + tile_outputs[i].begin;
+			std::copy(begin, begin + count, out.begin() + offsets[i]);
+		});
+	return total;
+}
+
+// Copies the elements of [first, last) for which pred(element) is true to out, preserving
+// their order. The iterators must be random access.
+template<typename InputIt, typename T, typename Pred>
+size_t compact_if(InputIt first, InputIt last, std::vector<T> &out, Pred pred) {
+	const size_t n = last - first;
+	const size_t num_tiles = (n + compact_tile_size - 1) / compact_tile_size;
+	return compact_tiles(num_tiles, out,
+		[&](const size_t t, std::vector<T> &buffer) {
+			const auto end = first + std::min(n, (t + 1) * compact_tile_size);
+			for (auto it = first + t * compact_tile_size; it != end; ++it) {
+				if (pred(*it)) {
+					buffer.push_back(*it);
+				}
+			}
 		});
-	out.pop_back();
-	return sum;
 }
 
+// Segmented inclusive scan of [first, last) into out, where a non-zero head flag starts a new
+// segment at that element. All segments are scanned in a single parallel launch, and out may be
+// first to scan in place. Returns the reduction of the last segment.
+template<typename InputIt, typename FlagIt, typename OutputIt, typename T, typename Op>
+T segmented_inclusive_scan(InputIt first, InputIt last, FlagIt head_flags, OutputIt out,
+		const T &id, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	return detail::segmented_scan<true>(first, out, size_t(last - first), id, op, backend,
+			detail::FlagHeads<FlagIt>{head_flags}, [](const size_t, const T &) {});
+}
+
+// Segmented exclusive scan of [first, last) into out, where a non-zero head flag starts a new
+// segment at that element. The first output of each segment is id. out may be first to scan
+// in place. Returns the reduction of the last segment.
+template<typename InputIt, typename FlagIt, typename OutputIt, typename T, typename Op>
+T segmented_exclusive_scan(InputIt first, InputIt last, FlagIt head_flags, OutputIt out,
+		const T &id, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	return detail::segmented_scan<false>(first, out, size_t(last - first), id, op, backend,
+			detail::FlagHeads<FlagIt>{head_flags}, [](const size_t, const T &) {});
+}
+
+template<typename T, typename Flag, typename Op>
+T segmented_inclusive_scan(const std::vector<T> &in, const std::vector<Flag> &head_flags,
+		const T &id, std::vector<T> &out, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	return segmented_inclusive_scan(in.begin(), in.end(), head_flags.begin(), out.begin(),
+			id, op, backend);
+}
+
+template<typename T, typename Flag, typename Op>
+T segmented_exclusive_scan(const std::vector<T> &in, const std::vector<Flag> &head_flags,
+		const T &id, std::vector<T> &out, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	return segmented_exclusive_scan(in.begin(), in.end(), head_flags.begin(), out.begin(),
+			id, op, backend);
+}
+
+// Segmented scans where segment s starts at segment_offsets[s], given as a sorted array
+// of offsets into [first, last). Empty segments are allowed. The total of each segment is
+// written to segment_totals, which is resized to the number of segments.
+template<typename T, typename Offset, typename Op>
+void segmented_inclusive_scan_offsets(const std::vector<T> &in,
+		const std::vector<Offset> &segment_offsets, const T &id, std::vector<T> &out,
+		std::vector<T> &segment_totals, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	segment_totals.assign(segment_offsets.size(), id);
+	detail::segmented_scan<true>(in.begin(), out.begin(), in.size(), id, op, backend,
+		detail::OffsetHeads<typename std::vector<Offset>::const_iterator>{
+			segment_offsets.begin(), segment_offsets.end(), in.size()},
+		[&](const size_t s, const T &total) {
+			segment_totals[s] = total;
+		});
+}
+
+template<typename T, typename Offset, typename Op>
+void segmented_exclusive_scan_offsets(const std::vector<T> &in,
+		const std::vector<Offset> &segment_offsets, const T &id, std::vector<T> &out,
+		std::vector<T> &segment_totals, Op op, ScanBackend backend = ScanBackend::TBB)
+{
+	out.resize(in.size());
+	segment_totals.assign(segment_offsets.size(), id);
+	detail::segmented_scan<false>(in.begin(), out.begin(), in.size(), id, op, backend,
+		detail::OffsetHeads<typename std::vector<Offset>::const_iterator>{
+			segment_offsets.begin(), segment_offsets.end(), in.size()},
+		[&](const size_t s, const T &total) {
+			segment_totals[s] = total;
+		});
+}
+
+// Offsets computed by two_level_exclusive_scan. If there are no block bases the scanned
+// values are the offsets themselves, otherwise each is local to its block of
+// 2^block_shift elements and is added to the block's 64-bit base.
+struct TwoLevelOffsets {
+	size_t block_shift = 0;
+	std::vector<uint64_t> block_bases;
+
+	bool is_two_level() const {
+		return !block_bases.empty();
+	}
+
+	template<typename T>
+	uint64_t operator()(const T *local, const size_t i) const {
+		return block_bases.empty() ? uint64_t(local[i]) : block_bases[i >> block_shift] + local[i];
+	}
+};
+
+// Exclusive scan in place of the n counts, each at most max_count, whose total may not fit
+// in the count type T. Scanning 32-bit counts keeps the scan's bandwidth at half that of
+// widening them to 64-bit, which only very large problems need. If n * max_count fits in
+// max_total (by default the range of T, and never more than it) a single scan is done. Otherwise the counts are
+// scanned within blocks small enough that the local offsets fit in T, one block per task,
+// and the block totals are scanned into 64-bit block bases. Returns the total of the counts.
+template<typename T>
+uint64_t two_level_exclusive_scan(T *counts, const size_t n, const T max_count,
+		TwoLevelOffsets &offsets, ScanBackend backend = ScanBackend::TBB,
+		const uint64_t max_total = std::numeric_limits<T>::max())
+{
+	static_assert(std::is_unsigned<T>::value, "two_level_exclusive_scan requires unsigned counts");
+	// The single scan and the block local offsets are computed in T, so a larger total would wrap
+	const uint64_t total_cap = std::min<uint64_t>(max_total, std::numeric_limits<T>::max());
+	offsets.block_bases.clear();
+	if (max_count == 0 || n <= total_cap / max_count) {
+		return ::exclusive_scan(counts, counts + n, counts, T(0), std::plus<T>{}, backend);
+	}
+	// The largest power of two block whose total fits, capped so there's enough blocks
+	// to scan in parallel
+	offsets.block_shift = 20;
+	while (offsets.block_shift > 0 && (uint64_t(1) << offsets.block_shift) > total_cap / max_count) {
+		--offsets.block_shift;
+	}
+	const size_t block_size = size_t(1) << offsets.block_shift;
+	const size_t num_blocks = (n + block_size - 1) / block_size;
+	auto &bases = offsets.block_bases;
+	bases.resize(num_blocks);
+	tbb::parallel_for(size_t(0), num_blocks,
+		[&](const size_t b) {
+			const size_t end = std::min(n, (b + 1) * block_size);
+			T sum = 0;
+			for (size_t i = b * block_size; i < end; ++i) {
+				const T c = counts[i];
+				counts[i] = sum;
+				sum += c;
+			}
+			bases[b] = sum;
+		});
+	return ::exclusive_scan(bases.data(), bases.data() + num_blocks, bases.data(), uint64_t(0),
+			std::plus<uint64_t>{}, backend);
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SCAN_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// The AVX2 kernels are compiled for AVX2 regardless of the flags the rest of the
+// program is built with and only called if the CPU supports them at runtime
+#if defined(SCAN_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_SIMD_AVX2 1
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// In-register prefix sum kernels for scans with std::plus over 32-bit integer and
+// float elements. Each kernel takes a carry in, the sum of all elements before in[0],
+// and returns the carry out for the next block. in and out may be the same array.
+// Note that the float kernels associate the additions differently than a serial loop,
+// as the parallel scans already do, so results may differ in the last bits.
+namespace simd {
+
+template<typename T>
+struct has_add_kernels : std::integral_constant<bool,
+	std::is_same<T, int32_t>::value || std::is_same<T, uint32_t>::value || std::is_same<T, float>::value>
+{};
+
+enum class Isa {
+	SCALAR,
+	SSE2,
+	AVX2
+};
+
+// Returns the best instruction set supported by the CPU we're running on
+inline Isa detect_isa() {
+	static const Isa isa = [] {
+#if defined(SCAN_SIMD_AVX2)
+		if (__builtin_cpu_supports("avx2")) {
+			return Isa::AVX2;
+		}
+#endif
+#if defined(SCAN_SIMD_X86)
+		return Isa::SSE2;
+#else
+		return Isa::SCALAR;
+#endif
+	}();
+	return isa;
+}
+
+template<typename T>
+T scalar_reduce_add(const T *in, const size_t n) {
+	T sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		sum += in[i];
+	}
+	return sum;
+}
+
+template<typename T>
+T scalar_inclusive_add(const T *in, T *out, const size_t n, T carry) {
+	for (size_t i = 0; i < n; ++i) {
+		carry += in[i];
+		out[i] = carry;
+	}
+	return carry;
+}
+
+template<typename T>
+T scalar_exclusive_add(const T *in, T *out, const size_t n, T carry) {
+	for (size_t i = 0; i < n; ++i) {
+		const T x = in[i];
+		out[i] = carry;
+		carry += x;
+	}
+	return carry;
+}
+
+#if defined(SCAN_SIMD_X86)
+
+// Prefix sum of the 4 lanes of x
+inline __m128i sse2_prefix(__m128i x) {
+	x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+	return _mm_add_epi32(x, _mm_slli_si128(x, 8));
+}
+
+inline __m128 sse2_prefix(__m128 x) {
+	x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+	return _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+}
+
+template<typename T>
+T sse2_reduce_add(const T *in, const size_t n) {
+	size_t i = 0;
+	T sum = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m128 acc = _mm_setzero_ps();
+		for (; i + 4 <= n; i += 4) {
+			acc = _mm_add_ps(acc, _mm_loadu_ps(in + i));
+		}
+		acc = sse2_prefix(acc);
+		sum = _mm_cvtss_f32(_mm_shuffle_ps(acc, acc, _MM_SHUFFLE(3, 3, 3, 3)));
+	} else {
+		__m128i acc = _mm_setzero_si128();
+		for (; i + 4 <= n; i += 4) {
+			acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+		}
+		acc = sse2_prefix(acc);
+		sum = T(_mm_cvtsi128_si32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+	return sum + scalar_reduce_add(in + i, n - i);
+}
+
+template<typename T>
+T sse2_inclusive_add(const T *in, T *out, const size_t n, T carry) {
+	size_t i = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m128 c = _mm_set1_ps(carry);
+		for (; i + 4 <= n; i += 4) {
+			const __m128 x = _mm_add_ps(sse2_prefix(_mm_loadu_ps(in + i)), c);
+			_mm_storeu_ps(out + i, x);
+			c = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		carry = _mm_cvtss_f32(c);
+	} else {
+		__m128i c = _mm_set1_epi32(int32_t(carry));
+		for (; i + 4 <= n; i += 4) {
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			x = _mm_add_epi32(sse2_prefix(x), c);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+			c = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		carry = T(_mm_cvtsi128_si32(c));
+	}
+	return scalar_inclusive_add(in + i, out + i, n - i, carry);
+}
+
+template<typename T>
+T sse2_exclusive_add(const T *in, T *out, const size_t n, T carry) {
+	size_t i = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m128 c = _mm_set1_ps(carry);
+		for (; i + 4 <= n; i += 4) {
+			const __m128 x = _mm_loadu_ps(in + i);
+			const __m128 shifted = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4));
+			const __m128 e = _mm_add_ps(sse2_prefix(shifted), c);
+			_mm_storeu_ps(out + i, e);
+			const __m128 last = _mm_add_ps(e, x);
+			c = _mm_shuffle_ps(last, last, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		carry = _mm_cvtss_f32(c);
+	} else {
+		__m128i c = _mm_set1_epi32(int32_t(carry));
+		for (; i + 4 <= n; i += 4) {
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			const __m128i e = _mm_add_epi32(sse2_prefix(_mm_slli_si128(x, 4)), c);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), e);
+			c = _mm_shuffle_epi32(_mm_add_epi32(e, x), _MM_SHUFFLE(3, 3, 3, 3));
+		}
+		carry = T(_mm_cvtsi128_si32(c));
+	}
+	return scalar_exclusive_add(in + i, out + i, n - i, carry);
+}
+
+#endif
+
+#if defined(SCAN_SIMD_AVX2)
+
+// Prefix sum of the 8 lanes of x: scan each 128-bit half, then add
+// the total of the low half to the high half
+SCAN_TARGET_AVX2 inline __m256i avx2_prefix(__m256i x) {
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+	__m256i t = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+	t = _mm256_permute2x128_si256(t, t, 0x08);
+	return _mm256_add_epi32(x, t);
+}
+
+SCAN_TARGET_AVX2 inline __m256 avx2_prefix(__m256 x) {
+	x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+	x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+	__m256 t = _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3));
+	t = _mm256_permute2f128_ps(t, t, 0x08);
+	return _mm256_add_ps(x, t);
+}
+
+// Broadcast the last lane of x to all lanes
+SCAN_TARGET_AVX2 inline __m256i avx2_broadcast_last(const __m256i x) {
+	const __m256i t = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_permute2x128_si256(t, t, 0x11);
+}
+
+SCAN_TARGET_AVX2 inline __m256 avx2_broadcast_last(const __m256 x) {
+	const __m256 t = _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_permute2f128_ps(t, t, 0x11);
+}
+
+// Shift the lanes of x up by one, shifting in a zero
+SCAN_TARGET_AVX2 inline __m256i avx2_shift_up(const __m256i x) {
+	const __m256i p = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	return _mm256_blend_epi32(p, _mm256_setzero_si256(), 0x01);
+}
+
+SCAN_TARGET_AVX2 inline __m256 avx2_shift_up(const __m256 x) {
+	const __m256 p = _mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	return _mm256_blend_ps(p, _mm256_setzero_ps(), 0x01);
+}
+
+template<typename T>
+SCAN_TARGET_AVX2 T avx2_reduce_add(const T *in, const size_t n) {
+	size_t i = 0;
+	T sum = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m256 acc = _mm256_setzero_ps();
+		for (; i + 8 <= n; i += 8) {
+			acc = _mm256_add_ps(acc, _mm256_loadu_ps(in + i));
+		}
+		sum = _mm256_cvtss_f32(avx2_broadcast_last(avx2_prefix(acc)));
+	} else {
+		__m256i acc = _mm256_setzero_si256();
+		for (; i + 8 <= n; i += 8) {
+			acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+		}
+		sum = T(_mm256_cvtsi256_si32(avx2_broadcast_last(avx2_prefix(acc))));
+	}
+	return sum + scalar_reduce_add(in + i, n - i);
+}
+
+template<typename T>
+SCAN_TARGET_AVX2 T avx2_inclusive_add(const T *in, T *out, const size_t n, T carry) {
+	size_t i = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m256 c = _mm256_set1_ps(carry);
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_add_ps(avx2_prefix(_mm256_loadu_ps(in + i)), c);
+			_mm256_storeu_ps(out + i, x);
+			c = avx2_broadcast_last(x);
+		}
+		carry = _mm256_cvtss_f32(c);
+	} else {
+		__m256i c = _mm256_set1_epi32(int32_t(carry));
+		for (; i + 8 <= n; i += 8) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			x = _mm256_add_epi32(avx2_prefix(x), c);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+			c = avx2_broadcast_last(x);
+		}
+		carry = T(_mm256_cvtsi256_si32(c));
+	}
+	return scalar_inclusive_add(in + i, out + i, n - i, carry);
+}
+
+template<typename T>
+SCAN_TARGET_AVX2 T avx2_exclusive_add(const T *in, T *out, const size_t n, T carry) {
+	size_t i = 0;
+	if constexpr (std::is_same<T, float>::value) {
+		__m256 c = _mm256_set1_ps(carry);
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_loadu_ps(in + i);
+			const __m256 e = _mm256_add_ps(avx2_prefix(avx2_shift_up(x)), c);
+			_mm256_storeu_ps(out + i, e);
+			c = avx2_broadcast_last(_mm256_add_ps(e, x));
+		}
+		carry = _mm256_cvtss_f32(c);
+	} else {
+		__m256i c = _mm256_set1_epi32(int32_t(carry));
+		for (; i + 8 <= n; i += 8) {
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			const __m256i e = _mm256_add_epi32(avx2_prefix(avx2_shift_up(x)), c);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), e);
+			c = avx2_broadcast_last(_mm256_add_epi32(e, x));
+		}
+		carry = T(_mm256_cvtsi256_si32(c));
+	}
+	return scalar_exclusive_add(in + i, out + i, n - i, carry);
+}
+
+#endif
+
+// Returns the sum of in[0, n)
+template<typename T>
+T reduce_add(const T *in, const size_t n) {
+	static_assert(has_add_kernels<T>::value, "No SIMD add kernels for this type");
+	switch (detect_isa()) {
+#if defined(SCAN_SIMD_AVX2)
+	case Isa::AVX2: return avx2_reduce_add(in, n);
+#endif
+#if defined(SCAN_SIMD_X86)
+	case Isa::SSE2: return sse2_reduce_add(in, n);
+#endif
+	default: return scalar_reduce_add(in, n);
+	}
+}
+
+// Writes out[i] = carry + in[0] + ... + in[i] and returns the carry for the next block
+template<typename T>
+T inclusive_scan_add(const T *in, T *out, const size_t n, const T carry) {
+	static_assert(has_add_kernels<T>::value, "No SIMD add kernels for this type");
+	switch (detect_isa()) {
+#if defined(SCAN_SIMD_AVX2)
+	case Isa::AVX2: return avx2_inclusive_add(in, out, n, carry);
+#endif
+#if defined(SCAN_SIMD_X86)
+	case Isa::SSE2: return sse2_inclusive_add(in, out, n, carry);
+#endif
+	default: return scalar_inclusive_add(in, out, n, carry);
+	}
+}
+
+// Writes out[i] = carry + in[0] + ... + in[i - 1] and returns the carry for the next block
+template<typename T>
+T exclusive_scan_add(const T *in, T *out, const size_t n, const T carry) {
+	static_assert(has_add_kernels<T>::value, "No SIMD add kernels for this type");
+	switch (detect_isa()) {
+#if defined(SCAN_SIMD_AVX2)
+	case Isa::AVX2: return avx2_exclusive_add(in, out, n, carry);
+#endif
+#if defined(SCAN_SIMD_X86)
+	case Isa::SSE2: return sse2_exclusive_add(in, out, n, carry);
+#endif
+	default: return scalar_exclusive_add(in, out, n, carry);
+	}
+}
+
+}
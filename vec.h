@@ -0,0 +1,9 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+using vec3sz = std::array<size_t, 3>;
+using vec3f = std::array<float, 3>;
+using vec2f = std::array<float, 2>;
+using vec3i = std::array<int, 3>;
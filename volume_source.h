@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// How the extraction will touch the volume, passed on to the OS as a paging hint
+enum class VolumeAccess {
+	NORMAL,
+	// Full passes over the volume, the OS can read ahead aggressively
+	SEQUENTIAL,
+	// Only some regions are touched, e.g. when skipping bricks with a macrocell grid
+	// or querying a span space index, read ahead would just waste IO
+	RANDOM,
+	// The whole volume will be needed soon, start paging it in now
+	WILLNEED
+};
+
+// Read only volume data of voxel type T used by the extraction, stored row major in the
+// host's byte order. On POSIX systems the file is memory mapped, so opening is cheap and
+// only the pages the extraction touches are read. Mapped pages come from the shared page
+// cache, so concurrent processes on the same dataset don't each keep their own copy. On
+// Windows, or if the map fails, the file is read into memory instead. A VolumeSource can
+// also wrap an existing buffer.
+template<typename T>
+class VolumeSource {
+	const T *ptr = nullptr;
+	size_t n = 0;
+	// Storage used when the data isn't mapped
+	std::vector<T> buffer;
+	void *mapping = nullptr;
+	size_t mapping_size = 0;
+
+public:
+	VolumeSource() = default;
+
+	explicit VolumeSource(std::vector<T> data) : buffer(std::move(data)) {
+		ptr = buffer.data();
+		n = buffer.size();
+	}
+
+	// Open the first size voxels of the file. Throws if the file can't be opened or
+	// is too small to hold them.
+	VolumeSource(const std::string &path, const size_t size,
+			const VolumeAccess access = VolumeAccess::SEQUENTIAL)
+		: n(size)
+	{
+		if (size == 0) {
+			return;
+		}
+		const size_t bytes = size * sizeof(T);
+#ifndef _WIN32
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("Failed to open " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) < bytes) {
+			close(fd);
+			throw std::runtime_error("Volume file " + path + " is smaller than the volume dimensions");
+		}
+		void *m = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping holds its own reference to the file
+		close(fd);
+		if (m != MAP_FAILED) {
+			mapping = m;
+			mapping_size = bytes;
+			ptr = static_cast<const T*>(m);
+			advise(access);
+			return;
+		}
+#else
+		(void)access;
+#endif
+		read_file(path);
+	}
+
+	VolumeSource(const VolumeSource &) = delete;
+	VolumeSource& operator=(const VolumeSource &) = delete;
+
+	VolumeSource(VolumeSource &&other) {
+		*this = std::move(other);
+	}
+
+	VolumeSource& operator=(VolumeSource &&other) {
+		if (this != &other) {
+			unmap();
+			buffer = std::move(other.buffer);
+			mapping = other.mapping;
+			mapping_size = other.mapping_size;
+			n = other.n;
+			ptr = mapping ? other.ptr : buffer.data();
+			other.mapping = nullptr;
+			other.mapping_size = 0;
+			other.ptr = nullptr;
+			other.n = 0;
+		}
+		return *this;
+	}
+
+	~VolumeSource() {
+		unmap();
+	}
+
+	// Change the paging hint, e.g. once a full pass building an index is done and the
+	// remaining accesses are sparse. Does nothing if the volume isn't mapped.
+	void advise(const VolumeAccess access) const {
+#ifndef _WIN32
+		if (!mapping) {
+			return;
+		}
+		int advice = MADV_NORMAL;
+		switch (access) {
+		case VolumeAccess::NORMAL: advice = MADV_NORMAL; break;
+		case VolumeAccess::SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+		case VolumeAccess::RANDOM: advice = MADV_RANDOM; break;
+		case VolumeAccess::WILLNEED: advice = MADV_WILLNEED; break;
+		}
+		// The hint is only advisory, so failures are ignored
+		madvise(mapping, mapping_size, advice);
+#else
+		(void)access;
+#endif
+	}
+
+	bool is_mapped() const {
+		return mapping != nullptr;
+	}
+
+	const T* data() const {
+		return ptr;
+	}
+
+	size_t size() const {
+		return n;
+	}
+
+	const T& operator[](const size_t i) const {
+		return ptr[i];
+	}
+
+private:
+	void read_file(const std::string &path) {
+		std::ifstream fin(path.c_str(), std::ios::binary);
+		if (!fin) {
+			throw std::runtime_error("Failed to open " + path);
+		}
+		buffer.resize(n);
+		if (!fin.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(T))) {
+			throw std::runtime_error("Volume file " + path + " is smaller than the volume dimensions");
+		}
+		ptr = buffer.data();
+	}
+
+	void unmap() {
+#ifndef _WIN32
+		if (mapping) {
+			munmap(mapping, mapping_size);
+		}
+#endif
+		mapping = nullptr;
+		mapping_size = 0;
+	}
+};